@@ -0,0 +1,266 @@
+/*
+ * bench_micro.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+// Microbenchmarks of the data path (ImageProcessor and TIFF wrappers) on
+// generated images. Needs no prototxt, net or solver: make bench_micro
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <omp.h>
+#include <boost/program_options.hpp>
+#include "caffe_neural_tool.hpp"
+#include "benchmark.hpp"
+#include "benchmark_stats.hpp"
+#include "filesystem_utils.hpp"
+#include "image_processor.hpp"
+#include "philox_random.hpp"
+#include "tiffio_wrapper.hpp"
+#include "utils.hpp"
+
+namespace bopo = boost::program_options;
+
+using namespace caffe_neural;
+
+// Runs setup (untimed) and body (timed) per sample, body does calls units
+// of work. Prints and collects ms per sample statistics.
+class MicroHarness {
+ public:
+  MicroHarness(int warmup, int reps, std::string filter)
+      : warmup_(warmup),
+        reps_(reps),
+        filter_(filter) {
+  }
+
+  void Run(std::string name, long calls, std::function<void()> setup,
+           std::function<void()> body) {
+    if (filter_.size() > 0 && name.find(filter_) == std::string::npos) {
+      return;
+    }
+
+    std::vector<double> samples;
+    for (int run = 0; run < warmup_ + reps_; ++run) {
+      if (setup) {
+        setup();
+      }
+      std::chrono::time_point<std::chrono::high_resolution_clock> t_start =
+          std::chrono::high_resolution_clock::now();
+      body();
+      std::chrono::time_point<std::chrono::high_resolution_clock> t_end =
+          std::chrono::high_resolution_clock::now();
+      if (run >= warmup_) {
+        samples.push_back((t_end - t_start).count() / 1e6);
+      }
+    }
+
+    SampleStats stats = ComputeStats(samples);
+    double rate = calls / (stats.median / 1e3);
+    std::cout << std::left << std::setw(28) << name << std::right
+              << std::setw(14) << std::setprecision(6) << stats.median
+              << " ms" << std::setw(14) << stats.p90 << " ms"
+              << std::setw(16) << rate << " /s" << std::endl;
+
+    out_ << name << ";" << calls << ";" << std::setprecision(10)
+         << stats.mean;
+    WriteStats(out_, stats);
+    out_ << ";" << rate << std::endl;
+  }
+
+  // name;calls;mean;min;median;p90;p99;stddev [ms per sample];calls/s
+  std::string csv() {
+    return out_.str();
+  }
+
+ protected:
+  int warmup_;
+  int reps_;
+  std::string filter_;
+  std::stringstream out_;
+};
+
+int main(int argc, const char** argv) {
+
+  google::InitGoogleLogging(argv[0]);
+
+  int thread_count;
+  int size;
+  int images;
+  int channels;
+  int labels;
+  int patch_size;
+  int padding_size;
+  int pages;
+  int warmup;
+  int reps;
+  int patches;
+  int searches;
+  std::string filter;
+  std::string csv_file;
+
+  bopo::options_description desc("Allowed options");
+  desc.add_options()      //
+  ("help", "help message")      //
+  ("ompthreads",
+   bopo::value<int>(&thread_count)->default_value(omp_get_num_procs()),
+   "number of OpenMP threads to use")  //
+  ("size", bopo::value<int>(&size)->default_value(1024),
+   "generated image width and height")  //
+  ("images", bopo::value<int>(&images)->default_value(4),
+   "number of generated images")  //
+  ("channels", bopo::value<int>(&channels)->default_value(1),
+   "image channels")  //
+  ("labels", bopo::value<int>(&labels)->default_value(2), "label count")  //
+  ("patch_size", bopo::value<int>(&patch_size)->default_value(128),
+   "label patch size")  //
+  ("padding_size", bopo::value<int>(&padding_size)->default_value(102),
+   "patch padding (border)")  //
+  ("pages", bopo::value<int>(&pages)->default_value(8),
+   "TIFF stack pages")  //
+  ("warmup", bopo::value<int>(&warmup)->default_value(3),
+   "warmup samples")  //
+  ("reps", bopo::value<int>(&reps)->default_value(20),
+   "measured samples")  //
+  ("patches", bopo::value<int>(&patches)->default_value(100),
+   "DrawPatchRandom calls per sample")  //
+  ("searches", bopo::value<int>(&searches)->default_value(100000),
+   "BinarySearchPatch calls per sample")  //
+  ("filter", bopo::value<std::string>(&filter)->default_value(""),
+   "only run benchmarks containing this string")  //
+  ("csv", bopo::value<std::string>(&csv_file), "write the results (csv)")  //
+  ("verbose", "enable logging")  //
+   ;
+
+  bopo::variables_map varmap;
+  bopo::store(bopo::parse_command_line(argc, argv, desc), varmap);
+  bopo::notify(varmap);
+
+  if (varmap.count("help")) {
+    std::cout << desc << std::endl;
+    return 1;
+  }
+
+  FLAGS_logtostderr = 1;
+  if (!varmap.count("verbose")) {
+    // Init() logs the label frequencies on every call
+    FLAGS_minloglevel = 1;
+  }
+
+  omp_set_num_threads(thread_count);
+  cv::setNumThreads(thread_count);
+
+  std::vector<cv::Mat> raw_images;
+  std::vector<std::vector<cv::Mat>> label_images;
+  SyntheticTrainingImages(images, size, channels, labels, raw_images,
+                          label_images);
+
+  std::vector<float> label_boost(labels, 1.0);
+  std::unique_ptr<TrainImageProcessor> processor;
+
+  // Processor with the images submitted, augmentations optional
+  auto make_processor = [&](bool augment, bool init) {
+    processor.reset(new TrainImageProcessor(patch_size, labels));
+    processor->SetBorderParams(true, padding_size / 2);
+    processor->SetLabelHistEqParams(true, true, true, label_boost);
+    processor->SetPatchMirrorParams(augment);
+    processor->SetRotationParams(augment);
+    processor->SetScaleParams(augment);
+    processor->SetTranslateParams(augment);
+    processor->SetBlurParams(augment, 0.0, 0.1, 5);
+    for (unsigned int j = 0; j < raw_images.size(); ++j) {
+      processor->SubmitImage(raw_images[j], j, label_images[j]);
+    }
+    if (init) {
+      processor->Init();
+    }
+  };
+
+  MicroHarness harness(warmup, reps, filter);
+
+  std::cout << std::left << std::setw(28) << "benchmark" << std::right
+            << std::setw(17) << "median" << std::setw(17) << "p90"
+            << std::setw(19) << "rate" << std::endl;
+
+  harness.Run("SubmitImage", images, [&]() {
+    processor.reset(new TrainImageProcessor(patch_size, labels));
+    processor->SetBorderParams(true, padding_size / 2);
+  }, [&]() {
+    for (unsigned int j = 0; j < raw_images.size(); ++j) {
+      processor->SubmitImage(raw_images[j], j, label_images[j]);
+    }
+  });
+
+  harness.Run("Init", 1, [&]() {
+    make_processor(false, false);
+  }, [&]() {
+    processor->Init();
+  });
+
+  make_processor(false, true);
+  std::vector<double> offsets(searches);
+  PhiloxRandom rng(GetTimeSeed(), 0);
+  for (int i = 0; i < searches; ++i) {
+    offsets[i] = rng.Uniform(0.0, processor->offset_range());
+  }
+  volatile long sink = 0;
+  harness.Run("BinarySearchPatch", searches, nullptr, [&]() {
+    long sum = 0;
+    for (int i = 0; i < searches; ++i) {
+      sum += processor->BinarySearchPatch(offsets[i]);
+    }
+    sink = sink + sum;
+  });
+
+  std::vector<float> patch_data(
+      (patch_size + padding_size) * (patch_size + padding_size) * channels);
+  std::vector<float> label_data(patch_size * patch_size);
+  std::vector<cv::Mat> patch;
+
+  auto draw = [&]() {
+    for (int i = 0; i < patches; ++i) {
+      processor->DrawPatchRandom(&patch_data[0], &label_data[0], patch);
+    }
+  };
+  harness.Run("DrawPatchRandom/none", patches, nullptr, draw);
+  make_processor(true, true);
+  harness.Run("DrawPatchRandom/all", patches, nullptr, draw);
+  processor.reset();
+
+  bofs::path tiffpath = bofs::temp_directory_path()
+      / bofs::unique_path("bench_micro_%%%%%%%%.tif");
+  std::vector<cv::Mat> stack(pages);
+  for (int p = 0; p < pages; ++p) {
+    stack[p] = raw_images[p % raw_images.size()];
+  }
+
+  harness.Run("SaveTiff", pages, nullptr, [&]() {
+    SaveTiff(stack, tiffpath.string());
+  });
+  harness.Run("LoadTiff", pages, [&]() {
+    if (!bofs::exists(tiffpath)) {
+      SaveTiff(stack, tiffpath.string());
+    }
+  }, [&]() {
+    std::vector<cv::Mat> loaded = LoadTiff(tiffpath.string(), channels);
+    sink = sink + loaded.size();
+  });
+  bofs::remove(tiffpath);
+
+  if (varmap.count("csv")) {
+    std::ofstream out_file(csv_file);
+    if (!out_file.is_open()) {
+      LOG(FATAL) << "Could not open benchmark output: " << csv_file;
+    }
+    out_file << harness.csv();
+  }
+
+  return 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * async_snapshot.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef ASYNC_SNAPSHOT_HPP_
+#define ASYNC_SNAPSHOT_HPP_
+
+#include <future>
+#include <string>
+#include "caffe_neural_tool.hpp"
+
+namespace caffe_neural {
+
+// Writes Caffe compatible binary proto snapshots (caffemodel and
+// solverstate) on a background thread. The weights and the solver history
+// are copied on the calling thread, training continues while the copy is
+// serialized and written. A new snapshot waits for the previous write.
+class AsyncSnapshotWriter {
+ public:
+  explicit AsyncSnapshotWriter(std::string prefix);
+  ~AsyncSnapshotWriter();
+  void Snapshot(Solver<float>* solver);
+  void Wait();
+
+ protected:
+  std::string prefix_;
+  std::future<void> pending_;
+};
+
+}  // namespace caffe_neural
+
+#endif /* ASYNC_SNAPSHOT_HPP_ */
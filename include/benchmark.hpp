@@ -15,6 +15,15 @@ using boost::shared_ptr;
 
 namespace caffe_neural {
 
+void FillUniform(cv::Mat &mat, uint64_t seed, uint64_t stream, float min,
+                 float max);
+
+// Synthetic training set: uniform noise images, labels in 32 pixel blocks
+void SyntheticTrainingImages(
+    int images, int size, int nr_channels, int nr_labels,
+    std::vector<cv::Mat>& raw_images,
+    std::vector<std::vector<cv::Mat>>& label_images);
+
 void FillNet(shared_ptr< Layer<float> > data_layer,
              shared_ptr< Layer<float> > label_layer, int num_output);
 
@@ -0,0 +1,55 @@
+/*
+ * benchmark_stats.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef BENCHMARK_STATS_HPP_
+#define BENCHMARK_STATS_HPP_
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace caffe_neural {
+
+struct SampleStats {
+  double mean;
+  double min;
+  double median;
+  double p90;
+  double p99;
+  double stddev;
+};
+
+// Statistics of the raw samples (nearest rank percentiles)
+SampleStats ComputeStats(std::vector<double> samples);
+
+// Appends ";min;median;p90;p99;stddev" to a benchmark CSV line
+void WriteStats(std::ostream &out, const SampleStats &stats);
+
+// Raw benchmark samples per section (CSV file stem) and name
+class BenchmarkReport {
+ public:
+  void Add(std::string section, std::string name,
+           const std::vector<double> &samples);
+  // All sections with statistics and raw samples
+  void WriteJSON(std::string file);
+  // Compares the medians with the CSV outputs of a previous run, writes the
+  // regressions beyond the threshold (relative) and returns their count
+  int CompareBaseline(std::string baseline_folder, double threshold,
+                      std::string output_file);
+
+ protected:
+  struct Entry {
+    std::string section;
+    std::string name;
+    std::vector<double> samples;
+    SampleStats stats;
+  };
+  std::vector<Entry> entries_;
+};
+
+}  // namespace caffe_neural
+
+#endif /* BENCHMARK_STATS_HPP_ */
@@ -47,6 +47,16 @@ struct CommonSettings
   int param_index;
   bool graphic;
   bool debug;
+  // Process() partitioning: static shard of shard_count, dynamic claims
+  // in claim_dir, multi-page stacks split into units of unit_pages pages
+  int shard_index = 0;
+  int shard_count = 1;
+  std::string claim_dir;
+  int claim_timeout = 300;
+  int unit_pages = 0;
+  // Process() continues from the checkpoints of interrupted units and
+  // skips finished units
+  bool resume = false;
 };
 
 
@@ -10,6 +10,7 @@
 
 #define FSU_ERR_EXCEPTION 1
 #define FSU_ERR_NO_FOLDER 2
+#define FSU_ERR_MISSING_ITEMS 3
 //#define FSU_ERR_
 
 #include <vector>
@@ -26,16 +27,6 @@ std::vector<bofs::path> LoadProcessSetItems(std::set<std::string> filetypes, std
 
 std::set<std::string> CreateImageTypesSet();
 
-std::function<unsigned int()> GetRandomSelector(unsigned int set_size);
-std::function<unsigned int()> GetRandomOffset(unsigned int min, unsigned int max);
-template<typename Dtype>
-std::function<Dtype()> GetRandomUniform(Dtype min, Dtype max);
-std::function<int()> GetRandomUniform(int min, int max);
-template<typename Dtype>
-std::function<Dtype()> GetRandomNormal(Dtype mu, Dtype std);
-
-
-
 }
 
 #endif /* FILESYSTEM_UTILS_HPP_ */
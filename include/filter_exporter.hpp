@@ -0,0 +1,66 @@
+/*
+ * filter_exporter.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef FILTER_EXPORTER_HPP_
+#define FILTER_EXPORTER_HPP_
+
+#include <future>
+#include <set>
+#include <string>
+#include <vector>
+#include "caffe_neural_tool.hpp"
+#include "filesystem_utils.hpp"
+
+namespace caffe_neural {
+
+// Copy of the selected channels of one network blob
+struct BlobCopy {
+  std::string name;
+  int num;
+  int height;
+  int width;
+  std::vector<int> channels;
+  std::vector<float> data;
+  std::vector<float> diff;
+};
+
+// Copy the selected blobs and channels (empty sets: all) of the net
+std::vector<BlobCopy> CopyBlobs(Net<float> *net, std::set<std::string> &blobs,
+                                std::set<int> &channels, bool store_diff);
+
+// Write blob copies as "png" (normalized 8 bit, one file per channel),
+// "tif" (multi-page fp32, one page per sample and channel) or "raw"
+// (int32 num, channels, height, width followed by the fp32 values)
+void WriteBlobs(const std::vector<BlobCopy> &copies, std::string output_folder,
+                bofs::path input_name, int st, int y, int x, std::string format);
+
+// Throttled filter export, the data is copied on the calling thread and
+// encoded and written on a background thread. Exports that are due while
+// the previous one is still being written are skipped.
+class FilterExporter {
+ public:
+  explicit FilterExporter(const FilterOutputParam &param);
+  ~FilterExporter();
+  bool enabled();
+  void Export(Net<float> *net, bofs::path input_name, int st, int y, int x,
+              bool store_diff);
+  void Wait();
+
+ protected:
+  bool enabled_;
+  std::string output_;
+  std::string format_;
+  int interval_;
+  std::set<std::string> blobs_;
+  std::set<int> channels_;
+  long calls_;
+  long skipped_;
+  std::future<void> pending_;
+};
+
+}  // namespace caffe_neural
+
+#endif /* FILTER_EXPORTER_HPP_ */
@@ -0,0 +1,18 @@
+/*
+ * generate.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef GENERATE_HPP_
+#define GENERATE_HPP_
+
+#include "caffe_neural_tool.hpp"
+
+namespace caffe_neural {
+
+int Generate(ToolParam &tool_param, CommonSettings &settings);
+
+}
+
+#endif /* GENERATE_HPP_ */
@@ -0,0 +1,65 @@
+/*
+ * hard_example_sampler.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef HARD_EXAMPLE_SAMPLER_HPP_
+#define HARD_EXAMPLE_SAMPLER_HPP_
+
+#include <vector>
+#include "philox_random.hpp"
+
+namespace caffe_neural {
+
+// Fenwick (binary indexed) tree over non-negative weights.
+// Weight updates and proportional sampling are both O(log n).
+class FenwickTree {
+ public:
+  FenwickTree();
+  void Resize(long n, double weight);
+  void Set(long i, double weight);
+  double weight(long i);
+  long size();
+  double total();
+  // Smallest index i with weight(0) + ... + weight(i) > value
+  long Find(double value);
+  void Rebuild();
+
+ protected:
+  std::vector<double> tree_;
+  std::vector<double> weights_;
+  double total_;
+  long top_step_;
+  long updates_;
+};
+
+// Samples patch offsets proportional to the recent training loss of the
+// coarse grid cell (cell_size x cell_size patch offsets) they fall into.
+// Patch ids are the flattened (image, y, x) offset ids of ImageProcessor.
+class HardExampleSampler {
+ public:
+  HardExampleSampler();
+  void Init(int images, int off_size_x, int off_size_y, int cell_size,
+            float momentum);
+  long Sample(PhiloxRandom &rng);
+  // Training loss of drawn patches, moves the averages of their cells
+  void Update(const std::vector<long> &abs_ids,
+              const std::vector<double> &losses);
+
+ protected:
+  long Cell(long abs_id);
+
+  FenwickTree cell_loss_;
+  int off_size_x_;
+  int off_size_y_;
+  int cell_size_;
+  int cells_x_;
+  int cells_y_;
+  float momentum_;
+  bool initialized_;
+};
+
+}  // namespace caffe_neural
+
+#endif /* HARD_EXAMPLE_SAMPLER_HPP_ */
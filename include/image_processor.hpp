@@ -11,11 +11,17 @@
 #include "opencv2/core/core.hpp"
 #include "opencv2/highgui/highgui.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
+#include <atomic>
 #include <functional>
+#include <stdint.h>
+#include "mat_pool.hpp"
+#include "philox_random.hpp"
+#include "hard_example_sampler.hpp"
 
 namespace caffe_neural {
 
 class InputParam;
+class PipelineStats;
 
 class ImageProcessor {
  public:
@@ -37,18 +43,35 @@ class ImageProcessor {
                             std::vector<float> label_boost);
   void SetScaleParams(bool apply);
   void SetTranslateParams(bool apply);
+  void SetHardMiningParams(bool apply, int cell_size, float mix,
+                           float momentum);
+  // Training loss of drawn patches (ids returned by DrawPatchRandom)
+  void UpdateLoss(const std::vector<long> &patch_ids,
+                  const std::vector<double> &losses);
+  bool hard_mining();
   void SetUpParams(InputParam &input_param, std::map<std::string, int> &params);
+  void SetSeed(uint64_t seed);
+  // Times the augmentation stages of DrawPatchRandom (nullptr: off)
+  void SetPipelineStats(PipelineStats *stats);
 
-  cv::Mat scale(float scale);
-  cv::Mat rotate(cv::Mat& src, double angle);
-  cv::Mat translate(double translate);
+  cv::Matx33d scale(float scale);
+  cv::Matx33d rotate(cv::Mat& src, double angle);
+  cv::Matx33d translate(double translate);
   long BinarySearchPatch(double offset);
+  // Upper bound of the offsets drawn for BinarySearchPatch, valid after Init()
+  double offset_range();
+  // Relative patch sampling weight per submitted image, set before Init()
+  void SetImageWeights(std::vector<float> weights);
 
   void SetLabelConsolidateParams(bool apply, std::vector<int> labels);
 
   std::vector<cv::Mat>& raw_images();
   std::vector<cv::Mat>& label_images();
   std::vector<int>& image_number();
+  // Drawn pixels per label (index 0: masked), see DrawPatchRandom
+  std::vector<long>& label_counter();
+  // Label to network label mapping (consolidation), valid after Init()
+  std::vector<float>& label_value();
 
  protected:
 
@@ -62,7 +85,16 @@ class ImageProcessor {
   int image_size_y_;
   int patch_size_;
   int nr_labels_;
-  std::function<double()> offset_selector_;
+  double offset_range_;
+
+  // Image sampling weights and their running sum over the patches of each
+  // image (without the label patch prior)
+  std::vector<float> image_weight_;
+  std::vector<double> image_running_weight_;
+  long WeightedPatch(double offset);
+
+  // Random streams, one per drawn patch: (seed_, sequence_index_)
+  uint64_t seed_;
 
   // Normalization parameters
   bool apply_normalization_ = false;
@@ -84,23 +116,18 @@ class ImageProcessor {
   float blur_mean_;
   float blur_std_;
   int blur_size_;
-  std::function<float()> blur_random_selector_;
 
   // Simple rotation parameters
   bool apply_rotation_ = false;
-  std::function<unsigned int()> rotation_rand_;
 
   // Simple scaling parameters
   bool apply_scaling_ = false;
-  std::function<float()> scale_rand_;
 
   // Simple translation parameters
   bool apply_translate_ = false;
-  std::function<int()> trans_rand_;
 
   // Patch mirroring
   bool apply_patch_mirroring_ = false;
-  std::function<unsigned int()> patch_mirror_rand_;
 
   // Label histrogram equalization
   bool apply_label_hist_eq_ = false;
@@ -108,16 +135,33 @@ class ImageProcessor {
   bool apply_label_pixel_mask_ = false;
   std::vector<double> label_running_probability_;
   std::vector<float> label_mask_probability_;
-  std::vector<std::function<float()>> label_mask_prob_rand_;
-  std::function<double()> label_patch_prior_rand_;
   std::vector<float> label_boost_;
 
+  // Hard example mining
+  bool apply_hard_mining_ = false;
+  int hard_mining_cell_size_;
+  float hard_mining_mix_;
+  float hard_mining_momentum_;
+  HardExampleSampler hard_sampler_;
+
   // Label consolidation
   bool label_consolidate_ = false;
   std::vector<int> label_consolidate_labels_;
 
-  // Patch sequence index
-  int sequence_index_;
+  // Per label output value (consolidated) and drawn pixel counts
+  std::vector<float> label_value_;
+  std::vector<long> label_counter_;
+
+  // Patch sequence index, DrawPatchRandom may be called concurrently
+  std::atomic<uint64_t> sequence_index_;
+
+  // Stage timing
+  PipelineStats *stats_ = nullptr;
+  int stage_mirror_;
+  int stage_warp_;
+  int stage_blur_;
+  int stage_write_;
+  int stage_label_;
 };
 
 class ProcessImageProcessor : public ImageProcessor {
@@ -129,8 +173,24 @@ class ProcessImageProcessor : public ImageProcessor {
 class TrainImageProcessor : public ImageProcessor {
  public:
   TrainImageProcessor(int patch_size, int nr_labels);
-  std::vector<cv::Mat> DrawPatchRandom();
+  // Writes the patch (CHW) and label directly into the given storage and
+  // sets the interleaved patch and the label in patch_label for inspection.
+  // Returns the patch id (see UpdateLoss). Safe to call from several
+  // threads (not concurrently with Init() or UpdateLoss()).
+  long DrawPatchRandom(float* patch_data, float* label_data,
+                       std::vector<cv::Mat> &patch_label);
+  MatPool& patch_pool();
  protected:
+  enum PoolSlot {
+    kMirrorPatch,
+    kMirrorLabel,
+    kWarpPatch,
+    kWarpLabel,
+    kBlurPatch,
+    kMaskRandom,
+    kPoolSlots
+  };
+  MatPool patch_pool_;
 };
 
 }
@@ -0,0 +1,50 @@
+/*
+ * manifest.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef MANIFEST_HPP_
+#define MANIFEST_HPP_
+
+#include <string>
+#include <vector>
+#include "caffe_neural_tool.hpp"
+#include "filesystem_utils.hpp"
+
+namespace caffe_neural {
+
+struct ManifestItem {
+  bofs::path raw;
+  // Label images (sorted), empty for processing
+  std::vector<bofs::path> labels;
+  // Page range of multi-page images (inclusive), -1: all pages
+  int first_page;
+  int last_page;
+  // Relative patch sampling weight (training)
+  float weight;
+};
+
+// Dataset manifest, one entry per line, '#' starts a comment:
+//   raw <path> [pages=<first>[-<last>]] [weight=<weight>]
+//   label <path>
+// Relative paths are relative to the manifest folder. Labels are paired
+// with the raw images of the same file stem, multiple labels of a raw image
+// are ordered by path (as the label subfolders). A stem may be listed
+// several times (e.g. page ranges of one stack), its labels then apply to
+// every item. Items with missing files (or without labels if required) are
+// dropped with a warning.
+std::vector<ManifestItem> LoadManifest(std::string file, bool require_labels,
+                                       int* error);
+
+// Items of the input parameters: the manifest if set, otherwise the raw
+// (and label) folders
+std::vector<ManifestItem> LoadInputItems(InputParam &input_param,
+                                         bool require_labels);
+
+// Restricts a loaded image stack to the page range of the item
+void SelectPages(const ManifestItem &item, std::vector<cv::Mat> &stack);
+
+}  // namespace caffe_neural
+
+#endif /* MANIFEST_HPP_ */
@@ -0,0 +1,37 @@
+/*
+ * mat_pool.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef MAT_POOL_HPP_
+#define MAT_POOL_HPP_
+
+#include <vector>
+#include "opencv2/core/core.hpp"
+
+namespace caffe_neural {
+
+// Per thread pool of scratch Mats, one Mat per slot and thread.
+// A slot is only (re)allocated when its size or type changes, so repeated
+// patch sized requests are served without touching the heap.
+class MatPool {
+ public:
+  explicit MatPool(int nr_slots);
+  cv::Mat& Get(int slot, int rows, int cols, int type);
+
+  long allocations();
+  long requests();
+  void ResetStats();
+
+ protected:
+  int nr_slots_;
+  std::vector<cv::Mat> mats_;
+  // Padded per thread counters, to avoid false sharing
+  std::vector<long> allocations_;
+  std::vector<long> requests_;
+};
+
+}  // namespace caffe_neural
+
+#endif /* MAT_POOL_HPP_ */
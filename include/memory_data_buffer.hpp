@@ -0,0 +1,55 @@
+/*
+ * memory_data_buffer.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef MEMORY_DATA_BUFFER_HPP_
+#define MEMORY_DATA_BUFFER_HPP_
+
+#include <vector>
+#include "caffe_neural_tool.hpp"
+#include "caffe/layers/memory_data_layer.hpp"
+
+namespace caffe_neural {
+
+// Copy a (possibly interleaved) float image into planar CHW storage.
+// The image must be CV_32F, dst must hold channels x rows x cols floats.
+void WritePlanar(const cv::Mat &src, float* dst);
+
+// Double buffered NCHW storage handed to a MemoryDataLayer with Reset.
+// Samples are written directly into the back buffer, Submit() passes it to
+// the layer and flips, so the layer never sees a buffer that is being filled.
+// Reset() bypasses the data transformer, so layers with a transform_param
+// are rejected.
+class MemoryDataBuffer {
+ public:
+  explicit MemoryDataBuffer(shared_ptr<Layer<float>> layer);
+  // Further layer of the same shape fed from the same buffers (ensembles:
+  // the samples are written once for all networks)
+  void AddLayer(shared_ptr<Layer<float>> layer);
+  float* sample(int n);
+  // Sample n of the buffer last handed to the layer (read only)
+  const float* submitted(int n);
+  // Checked WritePlanar into sample n: the image must be CV_32F and match
+  // the input layer shape (channels x height x width)
+  void Write(int n, const cv::Mat &src);
+  void Submit();
+
+  int num();
+  int channels();
+  int height();
+  int width();
+
+ protected:
+  shared_ptr<caffe::MemoryDataLayer<float>> layer_;
+  std::vector<shared_ptr<caffe::MemoryDataLayer<float>>> shared_layers_;
+  std::vector<float> data_[2];
+  std::vector<float> labels_;
+  int sample_size_;
+  int back_;
+};
+
+}  // namespace caffe_neural
+
+#endif /* MEMORY_DATA_BUFFER_HPP_ */
@@ -0,0 +1,74 @@
+/*
+ * memory_profiler.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef MEMORY_PROFILER_HPP_
+#define MEMORY_PROFILER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace caffe_neural {
+
+struct MemorySample {
+  double time;
+  const char* phase;
+  long rss;
+  long heap_used;
+  long heap_mapped;
+};
+
+// Samples the resident set size and the allocator statistics (all in kB)
+// on a background thread and at every phase change. Stop() writes the
+// timeline CSV and the per phase peaks (<file stem>_phases.csv).
+class MemoryProfiler {
+ public:
+  static MemoryProfiler& Get();
+  static bool enabled() {
+    return enabled_;
+  }
+
+  void Start(std::string file, int interval_ms);
+  void Stop();
+
+  // Static strings only
+  const char* phase();
+  void SetPhase(const char* phase);
+
+ protected:
+  MemoryProfiler();
+  void Sample();
+  void Write();
+
+  static bool enabled_;
+  std::string file_;
+  int interval_ms_;
+  std::atomic<const char*> phase_;
+  std::chrono::steady_clock::time_point start_;
+  bool running_;
+  std::mutex mutex_;
+  std::condition_variable stop_;
+  std::thread thread_;
+  std::vector<MemorySample> samples_;
+};
+
+// Sets the memory phase for its scope, restores the previous one after
+class MemoryPhase {
+ public:
+  explicit MemoryPhase(const char* phase);
+  ~MemoryPhase();
+
+ protected:
+  const char* previous_;
+};
+
+}  // namespace caffe_neural
+
+#endif /* MEMORY_PROFILER_HPP_ */
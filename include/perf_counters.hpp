@@ -0,0 +1,78 @@
+/*
+ * perf_counters.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef PERF_COUNTERS_HPP_
+#define PERF_COUNTERS_HPP_
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace caffe_neural {
+
+// Linux perf_event counters, opened on every thread of the OpenMP pool and
+// summed when read. Hardware counters (cycles, instructions, cache misses)
+// if the PMU is accessible, otherwise software counters (task clock [ns],
+// page faults). Threads outside the OpenMP pool are not counted, in
+// particular the BLAS threads (OpenBLAS keeps its own pthread pool): for
+// GEMM heavy layers only the work of the calling threads is covered.
+// The pool is the one of omp_get_max_threads() at Open(), call Reopen()
+// after omp_set_num_threads.
+class PerfCounters {
+ public:
+  PerfCounters();
+  ~PerfCounters();
+  // False if no counters could be opened (kernel support or
+  // /proc/sys/kernel/perf_event_paranoid)
+  bool Open();
+  // Opens the counters again on the current OpenMP pool (if enabled)
+  void Reopen();
+  void Close();
+  bool enabled() const;
+  bool hardware() const;
+  // Column names of WritePerfCounts
+  std::vector<std::string> columns() const;
+  // Current counts, scaled for multiplexing
+  std::vector<double> Read();
+
+ protected:
+  bool OpenSet(const std::vector<std::pair<int, int>> &events);
+
+  // [thread][counter]
+  std::vector<std::vector<int>> fds_;
+  std::vector<std::string> names_;
+  bool hardware_;
+};
+
+// Counter deltas summed over the measured samples
+struct PerfCounts {
+  std::vector<double> sum;
+  long samples;
+};
+
+// Adds the counter deltas of its own scope to counts, as samples samples
+// (e.g. a loop of calls). Does nothing without (enabled) counters or counts.
+// The reads are syscalls: open the scope outside of timed regions.
+class PerfScope {
+ public:
+  PerfScope(PerfCounters *counters, PerfCounts *counts, long samples = 1);
+  ~PerfScope();
+
+ protected:
+  PerfCounters *counters_;
+  PerfCounts *counts_;
+  long samples_;
+  std::vector<double> start_;
+};
+
+// Appends ";count" per counter with the mean per sample, and ";IPC" for
+// hardware counters
+void WritePerfCounts(std::ostream &out, const PerfCounters &counters,
+                     const PerfCounts &counts);
+
+}  // namespace caffe_neural
+
+#endif /* PERF_COUNTERS_HPP_ */
@@ -0,0 +1,132 @@
+/*
+ * philox_random.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef PHILOX_RANDOM_HPP_
+#define PHILOX_RANDOM_HPP_
+
+#include <stdint.h>
+#include <cmath>
+#include <algorithm>
+
+namespace caffe_neural {
+
+// Counter based Philox4x32-10 generator (Salmon et al., SC'11).
+// A (seed, stream) pair selects an independent sequence and every block of
+// four words is a pure function of (seed, stream, block), so results do not
+// depend on which thread draws them or in which order streams are consumed.
+class PhiloxRandom {
+ public:
+  PhiloxRandom(uint64_t seed, uint64_t stream)
+      : seed_(seed),
+        stream_(stream),
+        block_(0),
+        pos_(4) {
+  }
+
+  // Four random words of the given block
+  inline void Block(uint64_t block, uint32_t out[4]) const {
+    uint32_t c[4] = { (uint32_t) block, (uint32_t) (block >> 32),
+        (uint32_t) stream_, (uint32_t) (stream_ >> 32) };
+    uint32_t k[2] = { (uint32_t) seed_, (uint32_t) (seed_ >> 32) };
+    for (int r = 0; r < 10; ++r) {
+      uint64_t p0 = (uint64_t) 0xD2511F53 * c[0];
+      uint64_t p1 = (uint64_t) 0xCD9E8D57 * c[2];
+      uint32_t n0 = (uint32_t) (p1 >> 32) ^ c[1] ^ k[0];
+      uint32_t n2 = (uint32_t) (p0 >> 32) ^ c[3] ^ k[1];
+      c[1] = (uint32_t) p1;
+      c[3] = (uint32_t) p0;
+      c[0] = n0;
+      c[2] = n2;
+      k[0] += 0x9E3779B9;
+      k[1] += 0xBB67AE85;
+    }
+    out[0] = c[0];
+    out[1] = c[1];
+    out[2] = c[2];
+    out[3] = c[3];
+  }
+
+  // Sequential interface
+  inline uint32_t operator()() {
+    if (pos_ == 4) {
+      Block(block_++, buffer_);
+      pos_ = 0;
+    }
+    return buffer_[pos_++];
+  }
+
+  // Uniform in [min, max)
+  inline float Uniform(float min, float max) {
+    return min + (max - min) * ToFloat((*this)());
+  }
+
+  inline double Uniform(double min, double max) {
+    uint64_t a = (*this)();
+    uint64_t b = (*this)();
+    return min
+        + (max - min) * (double) (((a << 32) | b) >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+  // Uniform in [min, max]
+  inline int UniformInt(int min, int max) {
+    uint64_t range = (uint64_t) ((int64_t) max - (int64_t) min + 1);
+    return min + (int) ((range * (*this)()) >> 32);
+  }
+
+  inline float Normal(float mu, float std) {
+    // Box-Muller, u1 in (0, 1]
+    float u1 = 1.0f - ToFloat((*this)());
+    float u2 = ToFloat((*this)());
+    return mu
+        + std * std::sqrt(-2.0f * std::log(u1))
+            * std::cos(6.283185307179586f * u2);
+  }
+
+  // Fisher-Yates shuffle driven by this stream
+  template<typename T>
+  inline void Shuffle(T* first, int n) {
+    for (int i = n - 1; i > 0; --i) {
+      std::swap(first[i], first[UniformInt(0, i)]);
+    }
+  }
+
+  // Bulk generation of n uniform floats in [0, 1), starting at the given
+  // block. Independent of the sequential state, so disjoint block ranges
+  // can be generated concurrently.
+  inline void FillUniform(float* dst, long n, uint64_t first_block) const {
+    long blocks = (n + 3) / 4;
+#pragma omp simd
+    for (long b = 0; b < blocks - 1; ++b) {
+      uint32_t words[4];
+      Block(first_block + b, words);
+      for (int i = 0; i < 4; ++i) {
+        dst[b * 4 + i] = ToFloat(words[i]);
+      }
+    }
+    if (blocks > 0) {
+      uint32_t words[4];
+      Block(first_block + blocks - 1, words);
+      for (long i = (blocks - 1) * 4; i < n; ++i) {
+        dst[i] = ToFloat(words[i - (blocks - 1) * 4]);
+      }
+    }
+  }
+
+  static inline float ToFloat(uint32_t x) {
+    return (x >> 8) * (1.0f / 16777216.0f);
+  }
+
+ protected:
+  uint64_t seed_;
+  uint64_t stream_;
+  uint64_t block_;
+  int pos_;
+  uint32_t buffer_[4];
+};
+
+}  // namespace caffe_neural
+
+#endif /* PHILOX_RANDOM_HPP_ */
@@ -0,0 +1,86 @@
+/*
+ * pipeline_stats.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef PIPELINE_STATS_HPP_
+#define PIPELINE_STATS_HPP_
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "caffe_neural_tool.hpp"
+
+namespace caffe_neural {
+
+// Log scale histogram buckets, 8 per octave starting at 1 us
+#define STATS_BUCKETS_PER_OCTAVE 8
+#define STATS_BUCKETS 256
+
+struct StageHistogram {
+  long count;
+  double sum;
+  double max;
+  std::vector<long> buckets;
+};
+
+// Per stage timing histograms, recorded per thread (no locking) and merged
+// when dumped. Stages must be added before recording starts.
+class PipelineStats {
+ public:
+  PipelineStats();
+  // Returns the index of the (new or existing) stage
+  int AddStage(std::string name);
+  void Record(int stage, double seconds);
+  // Output file, "csv" (one line per stage) or "json" (one line per dump)
+  void Open(std::string file, std::string format);
+  // Writes the statistics since the previous dump and resets them
+  void Dump(long iteration, long patches);
+  double Percentile(int stage, double q);
+  // Summed time (seconds) of a stage since the previous dump
+  double Total(int stage);
+
+ protected:
+  StageHistogram Merge(int stage);
+  void Reset();
+
+  std::vector<std::string> names_;
+  std::vector<std::vector<StageHistogram>> threads_;
+  std::ofstream out_file_;
+  bool json_;
+  long last_iteration_;
+  long last_patches_;
+  std::chrono::steady_clock::time_point last_time_;
+};
+
+// Times its own scope, does nothing without statistics
+class StageTimer {
+ public:
+  StageTimer(PipelineStats *stats, int stage);
+  ~StageTimer();
+
+ protected:
+  PipelineStats *stats_;
+  int stage_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Splits Solver::Step into the forward/backward pass and the update
+class SolverStageTimer : public caffe::Solver<float>::Callback {
+ public:
+  SolverStageTimer(PipelineStats *stats);
+
+ protected:
+  void on_start();
+  void on_gradients_ready();
+
+  PipelineStats *stats_;
+  int stage_forward_backward_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace caffe_neural
+
+#endif /* PIPELINE_STATS_HPP_ */
@@ -10,13 +10,48 @@
 
 #include "caffe_neural_tool.hpp"
 #include "filesystem_utils.hpp"
+#include "memory_data_buffer.hpp"
+#include "pipeline_stats.hpp"
+#include <functional>
 
 namespace caffe_neural {
 
 int Process(caffe_neural::ToolParam &tool_param, CommonSettings &settings);
 
-int ExportFilters(Net<float> *net, std::string output_folder,
-                  bofs::path input_name, int st, int y, int x, bool store_diff);
+// Copy one network output tile (labels x patch x patch) to the label images
+// at (yoff, xoff), converting to the label image type on the fly.
+void ScatterTile(const float* tile, int patch_size, int yoff, int xoff,
+                 unsigned int label_offset, double scale,
+                 std::vector<cv::Mat> &outimgs);
+
+// Tiled forward pass over a preprocessed (padded) image. The label images
+// in outimgs must be allocated with the unpadded image size, tile_callback
+// is called with the tile indices and the number of tiles done after each
+// forward pass. With stats, the tile_input, forward and scatter stages are
+// timed. first_tile skips tiles already in outimgs (resumed checkpoint).
+void ProcessTiles(Net<float> &net, MemoryDataBuffer &input_buffer,
+                  const cv::Mat &padimage, int patch_size, int padding_size,
+                  int imagecrop, unsigned int label_offset, double scale,
+                  std::vector<cv::Mat> &outimgs,
+                  std::function<void(int, int, int)> tile_callback = nullptr,
+                  PipelineStats *stats = nullptr, int first_tile = 0);
+
+// Ensemble variant: the tiles are extracted once into input_buffer (shared
+// by the input layers of all nets, see MemoryDataBuffer::AddLayer), each
+// batch is forwarded through every net and the outputs are averaged with
+// the (normalized) weights before the scatter.
+void ProcessTiles(const std::vector<Net<float>*> &nets,
+                  const std::vector<float> &weights,
+                  MemoryDataBuffer &input_buffer,
+                  const cv::Mat &padimage, int patch_size, int padding_size,
+                  int imagecrop, unsigned int label_offset, double scale,
+                  std::vector<cv::Mat> &outimgs,
+                  std::function<void(int, int, int)> tile_callback = nullptr,
+                  PipelineStats *stats = nullptr, int first_tile = 0);
+
+// Preprocessor settings of the input parameters, returns the image crop
+int SetupProcessImageProcessor(ProcessImageProcessor &image_processor,
+                               InputParam &input_param);
 
 }
 
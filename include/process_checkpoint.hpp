@@ -0,0 +1,60 @@
+/*
+ * process_checkpoint.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef PROCESS_CHECKPOINT_HPP_
+#define PROCESS_CHECKPOINT_HPP_
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include "caffe_neural_tool.hpp"
+
+namespace caffe_neural {
+
+// Progress of one Process() work unit, in <folder>:
+//   slice_<slice>.mat  label outputs of a finished slice
+//   partial.mat        label outputs of the current slice (tiles done)
+//   partial.txt        "<slice> <tiles done>"
+// and the completion marker <folder>.done once all outputs are saved.
+// Files are written under a temporary name and renamed (atomic).
+class ProcessCheckpoint {
+ public:
+  // interval: minimum seconds between partial checkpoints
+  ProcessCheckpoint(std::string folder, double interval);
+
+  // Label outputs of a finished slice, false if not checkpointed
+  bool LoadSlice(int slice, std::vector<cv::Mat> &outimgs);
+  // Label outputs of a partial slice, returns the tiles done (0: none)
+  int LoadPartial(int slice, std::vector<cv::Mat> &outimgs);
+
+  void SaveSlice(int slice, const std::vector<cv::Mat> &outimgs);
+  // Rate limited, tiles_done are the tiles finished in outimgs
+  void SavePartial(int slice, int tiles_done,
+                   const std::vector<cv::Mat> &outimgs);
+
+  bool exists();
+  // Replaces the checkpoint by the completion marker, call once all
+  // outputs of the unit are written
+  void Complete();
+  // The unit was completed with checkpointing enabled
+  bool complete();
+  // Removes the checkpoint and the completion marker
+  void Clear();
+
+ protected:
+  std::string folder_;
+  double interval_;
+  std::chrono::steady_clock::time_point last_save_;
+};
+
+// Raw Mat stacks (int32 count, per Mat int32 rows, cols, type and data),
+// lossless for all types
+void SaveMats(std::string file, const std::vector<cv::Mat> &mats);
+bool LoadMats(std::string file, std::vector<cv::Mat> &mats);
+
+}  // namespace caffe_neural
+
+#endif /* PROCESS_CHECKPOINT_HPP_ */
@@ -0,0 +1,39 @@
+/*
+ * roofline.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef ROOFLINE_HPP_
+#define ROOFLINE_HPP_
+
+#include <ostream>
+#include "caffe_neural_tool.hpp"
+
+namespace caffe_neural {
+
+struct MachinePeak {
+  // Measured host peaks: FMA throughput (widest vector FMA the CPU
+  // supports, as used by BLAS) and stream triad bandwidth
+  double gflops;
+  double bandwidth;
+};
+
+// Built-in microbenchmarks with the current number of OpenMP threads
+MachinePeak MeasureMachinePeak();
+
+// Estimated memory traffic [bytes] of a layer from its blob sizes.
+// Forward: bottom and top data, parameters.
+// Backward: bottom data and diff, top diff, parameter data and diff.
+double LayerForwardBytes(Net<float> &net, int layer);
+double LayerBackwardBytes(Net<float> &net, int layer);
+
+// Appends ";GFLOP/s;bytes;GB/s;intensity;bound;efficiency" to a layer
+// timings CSV line. bound is "compute" or "memory" (right or left of the
+// ridge point), efficiency is the achieved share of the attainable rate.
+void WriteRoofline(std::ostream &out, double flops, double bytes,
+                   double time_ms, const MachinePeak &peak);
+
+}  // namespace caffe_neural
+
+#endif /* ROOFLINE_HPP_ */
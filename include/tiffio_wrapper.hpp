@@ -16,7 +16,12 @@
 namespace caffe_neural {
 
 void SaveTiff(std::vector<cv::Mat> image_stack, std::string file);
-std::vector<cv::Mat> LoadTiff(std::string file, int nr_channels);
+// Decodes only the pages first_page to last_page (-1: the last page),
+// clipped to the pages of the file
+std::vector<cv::Mat> LoadTiff(std::string file, int nr_channels,
+                              int first_page = 0, int last_page = -1);
+// Number of pages (directories), 0 if the file can not be opened
+int CountTiffPages(std::string file);
 
 
 }
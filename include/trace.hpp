@@ -0,0 +1,107 @@
+/*
+ * trace.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef TRACE_HPP_
+#define TRACE_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace caffe_neural {
+
+struct TraceEvent {
+  // Static string or interned by Tracer::Intern
+  const char* name;
+  char phase;
+  int64_t time;
+};
+
+struct TraceBuffer {
+  int tid;
+  std::vector<TraceEvent> events;
+};
+
+// Begin/end event recorder written in Chrome trace-event format
+// (chrome://tracing, Perfetto, JSON array format: a file cut off by a crash
+// still loads). Every thread appends to its own fixed size chunk, full
+// chunks are swapped out under a lock and written by a background thread,
+// so memory stays bounded on long runs.
+class Tracer {
+ public:
+  static Tracer& Get();
+  static bool enabled() {
+    return enabled_;
+  }
+
+  void Start(std::string file);
+  // Stable name pointer for dynamic names, call outside of hot loops
+  const char* Intern(std::string name);
+  void Record(const char* name, char phase);
+  // Writes the remaining events and finishes the file, threads must not
+  // record concurrently
+  void Close();
+
+ protected:
+  struct TraceChunk {
+    int tid;
+    std::vector<TraceEvent> events;
+  };
+
+  Tracer();
+  TraceBuffer* buffer();
+  // Hands the full chunk of a thread to the writer, takes a recycled one
+  void Flush(TraceBuffer* buffer);
+  void WriterLoop();
+  void WriteEvents(int tid, const std::vector<TraceEvent> &events);
+
+  static bool enabled_;
+  std::string file_;
+  std::chrono::steady_clock::time_point start_;
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<TraceBuffer>> buffers_;
+  std::set<std::string> names_;
+
+  // Background writer
+  std::ofstream out_file_;
+  long count_;
+  std::thread writer_;
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cv_;
+  std::deque<TraceChunk> full_;
+  std::vector<std::vector<TraceEvent>> free_;
+  bool stop_;
+};
+
+// Begin event on construction, end event on destruction
+class TraceScope {
+ public:
+  explicit TraceScope(const char* name)
+      : name_(name) {
+    if (Tracer::enabled()) {
+      Tracer::Get().Record(name_, 'B');
+    }
+  }
+  ~TraceScope() {
+    if (Tracer::enabled()) {
+      Tracer::Get().Record(name_, 'E');
+    }
+  }
+
+ protected:
+  const char* name_;
+};
+
+}  // namespace caffe_neural
+
+#endif /* TRACE_HPP_ */
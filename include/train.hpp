@@ -12,6 +12,20 @@
 
 namespace caffe_neural {
 
+typedef std::map<std::string, int> pmap;
+
+// Loads the raw images and their label images (one Mat per label image,
+// complement label added) of the training set folders or manifest, with
+// the manifest weight per image
+void LoadTrainingImages(InputParam& input_param, unsigned int nr_channels,
+                        unsigned int nr_labels,
+                        std::vector<cv::Mat>& raw_images,
+                        std::vector<std::vector<cv::Mat>>& label_images,
+                        std::vector<float>* image_weights = nullptr);
+
+void preload_process_images(TrainImageProcessor& image_processor,
+                            InputParam& input_param, pmap extra_param);
+
 int Train(ToolParam &tool_param, CommonSettings &settings);
 
 }
@@ -8,25 +8,24 @@
 #ifndef UTILS_HPP_
 #define UTILS_HPP_
 
-#include <functional>
 #include <string>
+#include <stdint.h>
 
 namespace caffe_neural {
 
 std::string ZeroPadNumber(int number, int total_size);
 
-std::function<unsigned int()> GetRandomSelector(unsigned int set_size);
+uint64_t GetTimeSeed();
 
-std::function<unsigned int()> GetRandomOffset(unsigned int min,
-                                              unsigned int max);
+// Peak resident set size of the process in kB
+long GetPeakRSS();
 
-template<typename Dtype>
-std::function<Dtype()> GetRandomUniform(Dtype min, Dtype max);
-
-template<typename Dtype>
-std::function<Dtype()> GetRandomNormal(Dtype mu, Dtype std);
-
-std::function<int()> GetRandomUniform(int min, int max);
+// Resets the resident set high-water mark (Linux clear_refs), false if
+// unsupported
+bool ResetPeakRSS();
+// Peak resident set size in kB since the last ResetPeakRSS() (VmHWM),
+// GetPeakRSS() if unavailable
+long GetWindowPeakRSS();
 
 }
 
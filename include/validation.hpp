@@ -0,0 +1,47 @@
+/*
+ * validation.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef VALIDATION_HPP_
+#define VALIDATION_HPP_
+
+#include "caffe_neural_tool.hpp"
+#include "memory_data_buffer.hpp"
+
+namespace caffe_neural {
+
+// Label maps are CV_32SC1, foreground maps CV_8UC1 with values 0 and 1.
+
+// Connected regions of equal label (4-connectivity), ids 0 to count - 1
+cv::Mat LabelSegments(const cv::Mat &labels, int* nr_segments);
+
+// Fraction of pixels with a different label
+double PixelError(const cv::Mat &prediction, const cv::Mat &truth);
+
+// 1 - Rand index of two segmentations, via a sparse contingency table
+double RandError(const cv::Mat &prediction_seg, int nr_prediction_seg,
+                 const cv::Mat &truth_seg, int nr_truth_seg);
+
+// Fraction of pixels that remain different after warping the truth towards
+// the prediction by flipping simple points only (Jain et al., 2010)
+double WarpingError(const cv::Mat &prediction_fg, const cv::Mat &truth_fg);
+
+struct ValidationResult {
+  double pixel_error;
+  double rand_error;
+  double warping_error;
+  int images;
+};
+
+// Tiled inference over the (preprocessed) test images of the processor
+// and segmentation metrics averaged over all images.
+ValidationResult Validate(Net<float> &net, MemoryDataBuffer &input_buffer,
+                          ImageProcessor &processor, int patch_size,
+                          int padding_size, int imagecrop, int nr_labels,
+                          int max_images);
+
+}  // namespace caffe_neural
+
+#endif /* VALIDATION_HPP_ */
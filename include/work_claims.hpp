@@ -0,0 +1,80 @@
+/*
+ * work_claims.hpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef WORK_CLAIMS_HPP_
+#define WORK_CLAIMS_HPP_
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "manifest.hpp"
+
+namespace caffe_neural {
+
+// Unit of Process() work: a file or a page range of a multi-page stack.
+// name is the output stem: the file stem, "<stem>_<first>-<last page>" for
+// page ranges and chunks. Duplicate names are fatal.
+struct WorkUnit {
+  ManifestItem item;
+  std::string name;
+};
+
+// One unit per item, multi-page TIFFs split into chunks of pages_per_unit
+// pages (0: whole files)
+std::vector<WorkUnit> MakeWorkUnits(const std::vector<ManifestItem> &items,
+                                    int pages_per_unit);
+
+// Static partitioning: every shards-th unit starting at shard
+std::vector<WorkUnit> ShardWorkUnits(const std::vector<WorkUnit> &units,
+                                     int shard, int shards);
+
+// Dynamic partitioning between tool instances sharing a work directory:
+//   <name>.claim  created with O_EXCL, holds host, pid and is touched as
+//                 heartbeat by a background thread while it is held
+//   <name>.done   written after the output is complete
+// Claims of dead workers (same host: pid gone, any host: no heartbeat for
+// timeout seconds) are renamed away atomically and claimed again.
+class WorkClaims {
+ public:
+  WorkClaims(std::string dir, int timeout);
+  ~WorkClaims();
+  // Claims the next open unit, waits while other workers hold live claims
+  // on the remaining units. Returns -1 when all units are done. Units seen
+  // done or claimed by this instance are not polled again (same units on
+  // every call).
+  int Next(const std::vector<WorkUnit> &units);
+  // Marks the current unit as done and releases its claim
+  void Done();
+
+ protected:
+  // Touches the current claim every timeout / 4 seconds, independent of
+  // the progress of loading, processing or saving
+  void HeartbeatLoop();
+  bool TryClaim(const std::string &name);
+  // Reads the owner of a claim, true if the owner is dead
+  bool IsStale(const std::string &claim_file, std::string &owner);
+  std::string ReadOwner(const std::string &claim_file);
+
+  std::string dir_;
+  int timeout_;
+  // Units not yet seen done or claimed by this instance, in order
+  bool started_;
+  std::vector<int> open_;
+  std::string host_;
+  std::string owner_;
+  // Current claim, shared with the heartbeat thread
+  std::string current_;
+  std::mutex mutex_;
+  std::condition_variable heartbeat_cv_;
+  bool stop_;
+  std::thread heartbeat_thread_;
+};
+
+}  // namespace caffe_neural
+
+#endif /* WORK_CLAIMS_HPP_ */
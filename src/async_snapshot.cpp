@@ -0,0 +1,79 @@
+/*
+ * async_snapshot.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "async_snapshot.hpp"
+#include "caffe/sgd_solvers.hpp"
+#include <memory>
+#include <sstream>
+
+namespace caffe_neural {
+
+// Learning rate schedule step at the given iteration, as restored by Caffe
+static int CurrentStep(const caffe::SolverParameter &param, int iter) {
+  if (param.lr_policy() == "step" && param.stepsize() > 0) {
+    return iter / param.stepsize();
+  }
+  int step = 0;
+  if (param.lr_policy() == "multistep") {
+    while (step < param.stepvalue_size() && iter >= param.stepvalue(step)) {
+      ++step;
+    }
+  }
+  return step;
+}
+
+AsyncSnapshotWriter::AsyncSnapshotWriter(std::string prefix)
+    : prefix_(prefix) {
+}
+
+AsyncSnapshotWriter::~AsyncSnapshotWriter() {
+  Wait();
+}
+
+void AsyncSnapshotWriter::Wait() {
+  if (pending_.valid()) {
+    pending_.get();
+  }
+}
+
+void AsyncSnapshotWriter::Snapshot(Solver<float>* solver) {
+  // Back-pressure: never more than one snapshot in flight
+  Wait();
+
+  std::stringstream ss;
+  ss << prefix_ << "_iter_" << solver->iter();
+  std::string model_filename = ss.str() + ".caffemodel";
+  std::string state_filename = ss.str() + ".solverstate";
+
+  // Copies of the parameters, taken before training continues
+  std::shared_ptr<NetParameter> net_param(new NetParameter());
+  solver->net()->ToProto(net_param.get(), solver->param().snapshot_diff());
+
+  std::shared_ptr<caffe::SolverState> state(new caffe::SolverState());
+  state->set_iter(solver->iter());
+  state->set_learned_net(model_filename);
+  state->set_current_step(CurrentStep(solver->param(), solver->iter()));
+  caffe::SGDSolver<float>* sgd_solver =
+      dynamic_cast<caffe::SGDSolver<float>*>(solver);
+  if (sgd_solver != NULL) {
+    for (unsigned int i = 0; i < sgd_solver->history().size(); ++i) {
+      sgd_solver->history()[i]->ToProto(state->add_history());
+    }
+  } else {
+    LOG(WARNING) << "Solver history not available, snapshot without it.";
+  }
+
+  pending_ = std::async(std::launch::async,
+                        [net_param, state, model_filename, state_filename]() {
+    LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
+    caffe::WriteProtoToBinaryFile(*net_param, model_filename);
+    LOG(INFO) << "Snapshotting solver state to binary proto file "
+        << state_filename;
+    caffe::WriteProtoToBinaryFile(*state, state_filename);
+  });
+}
+
+}  // namespace caffe_neural
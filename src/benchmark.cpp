@@ -14,16 +14,46 @@
 #include <cassert>
 #include "filesystem_utils.hpp"
 #include "utils.hpp"
+#include "philox_random.hpp"
+#include "trace.hpp"
+#include "train.hpp"
+#include "benchmark_stats.hpp"
+#include "roofline.hpp"
+#include "memory_profiler.hpp"
+#include "process.hpp"
+#include "pipeline_stats.hpp"
+#include "perf_counters.hpp"
+#include <omp.h>
 #include "caffe/layers/memory_data_layer.hpp"
 
 namespace caffe_neural {
 
 
+// Fill a continuous float Mat with uniform numbers in [min, max), in
+// parallel chunks of disjoint Philox blocks (race free and reproducible)
+void FillUniform(cv::Mat &mat, uint64_t seed, uint64_t stream, float min,
+                 float max) {
+  PhiloxRandom rng(seed, stream);
+  float* data = mat.ptr<float>();
+  long total = mat.total() * mat.channels();
+  long chunk = 4096;
+
+#pragma omp parallel for
+  for (long c = 0; c < (total - 1) / chunk + 1; ++c) {
+    long n = std::min(chunk, total - c * chunk);
+    float* dst = data + c * chunk;
+    rng.FillUniform(dst, n, c * chunk / 4);
+    for (long i = 0; i < n; ++i) {
+      dst[i] = min + (max - min) * dst[i];
+    }
+  }
+}
+
 void FillNet(shared_ptr< Layer<float> > data_layer,
              shared_ptr< Layer<float> > label_layer, int num_output) {
 
-  std::function<float()> rfu = GetRandomUniform<float>(-1.0, 1.0);
-  std::function<float()> riu = GetRandomUniform(0, num_output - 1);
+  static uint64_t seed = GetTimeSeed();
+  static uint64_t stream = 0;
 
   if (data_layer != NULL) {
     std::vector<cv::Mat> images;
@@ -38,15 +68,7 @@ void FillNet(shared_ptr< Layer<float> > data_layer,
     int bw = data_layer_ptr->width();
 
     cv::Mat image(bh, bw, CV_32FC(bc));
-
-#pragma omp parallel for
-    for (int h = 0; h < bh; ++h) {
-      for (int w = 0; w < bw; ++w) {
-        for (int c = 0; c < bc; ++c) {
-          *(image.ptr<float>(h, w) + c) = rfu();
-        }
-      }
-    }
+    FillUniform(image, seed, stream++, -1.0, 1.0);
 
     images.push_back(image);
     labels.push_back(0);
@@ -67,14 +89,13 @@ void FillNet(shared_ptr< Layer<float> > data_layer,
     int bw = layer_ptr->width();
 
     cv::Mat image(bh, bw, CV_32FC(bc));
+    FillUniform(image, seed, stream++, 0.0, num_output);
 
+    // Integer labels in [0, num_output - 1]
+    float* data = image.ptr<float>();
 #pragma omp parallel for
-    for (int h = 0; h < bh; ++h) {
-      for (int w = 0; w < bw; ++w) {
-        for (int c = 0; c < bc; ++c) {
-          *(image.ptr<float>(h, w) + c) = riu();
-        }
-      }
+    for (long i = 0; i < (long) (image.total() * bc); ++i) {
+      data[i] = std::min(std::floor(data[i]), (float) (num_output - 1));
     }
 
     images.push_back(image);
@@ -83,6 +104,793 @@ void FillNet(shared_ptr< Layer<float> > data_layer,
   }
 }
 
+// Synthetic training set: uniform noise images, labels in 32 pixel blocks
+void SyntheticTrainingImages(
+    int images, int size, int nr_channels, int nr_labels,
+    std::vector<cv::Mat>& raw_images,
+    std::vector<std::vector<cv::Mat>>& label_images) {
+  uint64_t seed = GetTimeSeed();
+  PhiloxRandom rng(seed, 0);
+  for (int i = 0; i < images; ++i) {
+    cv::Mat noise(size, size, CV_32FC(nr_channels));
+    FillUniform(noise, seed, i + 1, 0.0, 256.0);
+    cv::Mat raw;
+    noise.convertTo(raw, CV_8UC(nr_channels));
+
+    cv::Mat label(size, size, CV_8UC1);
+    for (int y = 0; y < size; y += 32) {
+      for (int x = 0; x < size; x += 32) {
+        cv::Rect block(x, y, std::min(32, size - x), std::min(32, size - y));
+        label(block).setTo(cv::Scalar(rng.UniformInt(0, nr_labels - 1)));
+      }
+    }
+
+    raw_images.push_back(raw);
+    label_images.push_back(std::vector<cv::Mat>(1, label));
+  }
+}
+
+struct PipelineConfig {
+  std::string name;
+  bool mirror;
+  bool rotation;
+  bool scale;
+  bool translate;
+  bool blur;
+  bool histeq;
+};
+
+// Times Init() and DrawPatchRandom with each augmentation alone and all
+// combined, per thread count (OpenMP and OpenCV)
+static void BenchmarkPipeline(PipelineBenchParam &pipeline_param,
+                              InputParam &input_param, int warmup_runs,
+                              bofs::path benchpath, PerfCounters *perf) {
+  int patch_size = input_param.patch_size();
+  int padding_size = input_param.padding_size();
+  int nr_channels = input_param.channels();
+  int nr_labels = input_param.labels();
+  PreprocessorParam preprocessor_param = input_param.preprocessor();
+  if (preprocessor_param.has_label_consolidate()) {
+    nr_labels = preprocessor_param.label_consolidate().label_size();
+  }
+
+  std::vector<cv::Mat> raw_images;
+  std::vector<std::vector<cv::Mat>> label_images;
+  if (pipeline_param.synthetic()) {
+    SyntheticTrainingImages(pipeline_param.images(),
+                            pipeline_param.image_size(), nr_channels,
+                            std::max(nr_labels, 1), raw_images, label_images);
+  } else {
+    LoadTrainingImages(input_param, nr_channels, nr_labels, raw_images,
+                       label_images);
+  }
+
+  std::vector<PipelineConfig> configs = {
+    { "none", false, false, false, false, false, false },
+    { "mirror", true, false, false, false, false, false },
+    { "rotation", false, true, false, false, false, false },
+    { "scale", false, false, true, false, false, false },
+    { "translate", false, false, false, true, false, false },
+    { "blur", false, false, false, false, true, false },
+    { "histeq", false, false, false, false, false, true },
+    { "all", true, true, true, true, true, true }
+  };
+
+  int max_threads = omp_get_max_threads();
+  std::vector<int> threads(pipeline_param.threads().begin(),
+                           pipeline_param.threads().end());
+  if (threads.size() == 0) {
+    threads.push_back(1);
+    if (max_threads > 1) {
+      threads.push_back(max_threads);
+    }
+  }
+
+  pmap extra_param;
+  extra_param["nr_channels"] = nr_channels;
+  extra_param["nr_labels"] = nr_labels;
+  extra_param["padding_size"] = padding_size;
+
+  PrepBlurParam blur_param = preprocessor_param.blur();
+  std::vector<float> label_boost(nr_labels, 1.0);
+
+  std::vector<float> patch_data(
+      (patch_size + padding_size) * (patch_size + padding_size) * nr_channels);
+  std::vector<float> label_data(patch_size * patch_size);
+  std::vector<cv::Mat> patch;
+
+  bofs::path filep = benchpath;
+  filep /= ("/pipeline_timings.csv");
+  std::ofstream out_file;
+  out_file.open(filep.string());
+  assert(out_file.is_open());
+
+  std::chrono::time_point<std::chrono::high_resolution_clock> t_start, t_end;
+
+  for (unsigned int t = 0; t < threads.size(); ++t) {
+    omp_set_num_threads(threads[t]);
+    cv::setNumThreads(threads[t]);
+    // Count the threads of the resized pool
+    if (perf != nullptr) {
+      perf->Reopen();
+    }
+
+    for (unsigned int c = 0; c < configs.size(); ++c) {
+      PipelineConfig &config = configs[c];
+
+      TrainImageProcessor image_processor(patch_size, nr_labels);
+      image_processor.SetBorderParams(input_param.has_padding_size(),
+                                      padding_size / 2);
+      if (input_param.has_preprocessor()) {
+        image_processor.SetUpParams(input_param, extra_param);
+      }
+      image_processor.SetPatchMirrorParams(config.mirror);
+      image_processor.SetRotationParams(config.rotation);
+      image_processor.SetScaleParams(config.scale);
+      image_processor.SetTranslateParams(config.translate);
+      image_processor.SetBlurParams(config.blur, blur_param.mean(),
+                                    blur_param.std(), blur_param.ksize());
+      image_processor.SetLabelHistEqParams(config.histeq, true, true,
+                                           label_boost);
+
+      for (unsigned int j = 0; j < raw_images.size(); ++j) {
+        image_processor.SubmitImage(raw_images[j], j, label_images[j]);
+      }
+
+      // Counter reads (syscalls) outside of the timed windows
+      PerfCounts init_perf = PerfCounts();
+      {
+        PerfScope scope(perf, &init_perf);
+        t_start = std::chrono::high_resolution_clock::now();
+        image_processor.Init();
+        t_end = std::chrono::high_resolution_clock::now();
+      }
+      double init_time = (double) ((t_end - t_start).count()) / 1e6;
+
+      for (int run = 0; run < warmup_runs; ++run) {
+        image_processor.DrawPatchRandom(&patch_data[0], &label_data[0], patch);
+      }
+
+      PerfCounts draw_perf = PerfCounts();
+      {
+        PerfScope scope(perf, &draw_perf, pipeline_param.patches());
+        t_start = std::chrono::high_resolution_clock::now();
+        for (int run = 0; run < pipeline_param.patches(); ++run) {
+          image_processor.DrawPatchRandom(&patch_data[0], &label_data[0],
+                                          patch);
+        }
+        t_end = std::chrono::high_resolution_clock::now();
+      }
+      double draw_time = (double) ((t_end - t_start).count()) / 1e6;
+      double patch_rate = pipeline_param.patches() / (draw_time / 1e3);
+
+      LOG(INFO) << "Pipeline (" << threads[t] << " threads, " << config.name
+          << "): Init " << std::setprecision(10) << init_time << " ms, "
+          << patch_rate << " patches/s";
+
+      out_file << threads[t] << ";" << config.name << ";"
+               << std::setprecision(10) << init_time << ";"
+               << draw_time / pipeline_param.patches() << ";" << patch_rate;
+      if (perf != nullptr && perf->enabled()) {
+        // Init, then per patch
+        WritePerfCounts(out_file, *perf, init_perf);
+        WritePerfCounts(out_file, *perf, draw_perf);
+      }
+      out_file << std::endl;
+    }
+  }
+  out_file.close();
+
+  omp_set_num_threads(max_threads);
+  cv::setNumThreads(max_threads);
+  if (perf != nullptr) {
+    perf->Reopen();
+  }
+}
+
+// Stack of pages as one multi-page TIFF or one PNG per page
+static void SaveStack(std::vector<cv::Mat> &stack, std::string format,
+                      std::string stem) {
+  if (format == "tif") {
+    SaveTiff(stack, stem + ".tif");
+  } else {
+    for (unsigned int p = 0; p < stack.size(); ++p) {
+      cv::imwrite(stem + "_" + ZeroPadNumber(p, 4) + ".png", stack[p]);
+    }
+  }
+}
+
+static long LoadStack(std::string format, std::string stem, int pages,
+                      int channels, int depth) {
+  long loaded = 0;
+  if (format == "tif") {
+    loaded = LoadTiff(stem + ".tif", channels).size();
+  } else {
+    for (int p = 0; p < pages; ++p) {
+      cv::Mat image = cv::imread(
+          stem + "_" + ZeroPadNumber(p, 4) + ".png",
+          depth > 8 ? CV_LOAD_IMAGE_ANYDEPTH :
+              (channels == 1 ? CV_LOAD_IMAGE_GRAYSCALE : CV_LOAD_IMAGE_COLOR));
+      loaded += image.empty() ? 0 : 1;
+    }
+  }
+  return loaded;
+}
+
+// Load and save throughput of generated stacks, sequential over the files
+// and in parallel (one file per thread)
+static void BenchmarkIO(IOBenchParam &io_param, int warmup_runs,
+                        int bench_runs, bofs::path benchpath) {
+  bofs::path iopath = io_param.has_path() ?
+      bofs::path(io_param.path()) : benchpath / "io";
+  bofs::create_directories(iopath);
+
+  int width = io_param.width();
+  int height = io_param.height();
+  int pages = io_param.pages();
+  int files = io_param.files();
+  int channels = io_param.channels();
+
+  std::vector<int> depths(io_param.depth().begin(), io_param.depth().end());
+  if (depths.size() == 0) {
+    depths.push_back(8);
+  }
+  std::vector<std::string> formats = { "tif", "png" };
+
+  bofs::path filep = benchpath;
+  filep /= ("/io_timings.csv");
+  std::ofstream out_file;
+  out_file.open(filep.string());
+  assert(out_file.is_open());
+
+  std::chrono::time_point<std::chrono::high_resolution_clock> t_start, t_end;
+  uint64_t seed = GetTimeSeed();
+
+  for (unsigned int f = 0; f < formats.size(); ++f) {
+    std::string format = formats[f];
+    for (unsigned int d = 0; d < depths.size(); ++d) {
+      int depth = depths[d];
+      bool save_only = (format == "tif" && depth == 32);
+      if ((format == "tif" && depth != 8 && depth != 32)
+          || (format == "png" && depth != 8 && depth != 16)
+          || (depth != 8 && channels != 1)) {
+        LOG(WARNING) << "Skipping unsupported I/O benchmark: " << format
+                     << ", " << depth << " bit, " << channels << " channels";
+        continue;
+      }
+
+      int type = depth == 8 ? CV_8UC(channels) :
+          (depth == 16 ? CV_16UC1 : CV_32FC1);
+      double max_value = depth == 8 ? 256.0 : (depth == 16 ? 65536.0 : 1.0);
+
+      std::vector<cv::Mat> stack(pages);
+      for (int p = 0; p < pages; ++p) {
+        cv::Mat noise(height, width, CV_32FC(channels));
+        FillUniform(noise, seed, p, 0.0, max_value);
+        noise.convertTo(stack[p], type);
+      }
+
+      double megabytes = (double) width * height * channels * (depth / 8)
+          * pages * files / (1024.0 * 1024.0);
+
+      std::vector<std::string> stems(files);
+      for (int i = 0; i < files; ++i) {
+        std::stringstream ss;
+        ss << format << "_" << depth << "_" << ZeroPadNumber(i, 4);
+        stems[i] = (iopath / ss.str()).string();
+      }
+
+      for (int parallel = 0; parallel < 2; ++parallel) {
+        std::string mode = parallel ? "parallel" : "single";
+
+        for (int op = 0; op < 2; ++op) {
+          bool save = (op == 0);
+          if (!save && save_only) {
+            continue;
+          }
+
+          // Peak memory of this configuration only
+          if (!ResetPeakRSS()) {
+            LOG(WARNING) << "Peak RSS can not be reset, the I/O timings "
+                         << "report the peak of the process";
+          }
+
+          double op_time = 0;
+          long loaded = 0;
+          for (int run = 0; run < warmup_runs + bench_runs; ++run) {
+            t_start = std::chrono::high_resolution_clock::now();
+#pragma omp parallel for if (parallel) reduction(+:loaded)
+            for (int i = 0; i < files; ++i) {
+              if (save) {
+                SaveStack(stack, format, stems[i]);
+              } else {
+                loaded += LoadStack(format, stems[i], pages, channels, depth);
+              }
+            }
+            t_end = std::chrono::high_resolution_clock::now();
+            if (run >= warmup_runs) {
+              op_time += (t_end - t_start).count();
+            }
+          }
+          op_time /= (double) bench_runs * 1e6;
+
+          if (!save && loaded != (long) pages * files
+              * (warmup_runs + bench_runs)) {
+            LOG(WARNING) << "I/O benchmark loaded " << loaded << " of "
+                << (long) pages * files * (warmup_runs + bench_runs)
+                << " pages (" << format << ", " << depth << " bit)";
+          }
+
+          double mb_rate = megabytes / (op_time / 1e3);
+          double page_rate = (double) pages * files / (op_time / 1e3);
+
+          LOG(INFO) << (save ? "Save " : "Load ") << format << " " << depth
+              << " bit (" << mode << "): " << std::setprecision(10) << op_time
+              << " ms, " << mb_rate << " MB/s, " << page_rate << " pages/s";
+
+          out_file << format << ";" << depth << ";" << channels << ";"
+                   << pages << ";" << mode << ";" << (save ? "save" : "load")
+                   << ";" << std::setprecision(10) << op_time << ";"
+                   << mb_rate << ";" << page_rate << ";"
+                   << GetWindowPeakRSS() << std::endl;
+        }
+      }
+
+      if (!io_param.keep_files()) {
+        for (int i = 0; i < files; ++i) {
+          bofs::remove(stems[i] + ".tif");
+          for (int p = 0; p < pages; ++p) {
+            bofs::remove(stems[i] + "_" + ZeroPadNumber(p, 4) + ".png");
+          }
+        }
+      }
+    }
+  }
+  out_file.close();
+}
+
+// Interned "<layer> <pass>" trace event names, one per layer
+static std::vector<const char*> TraceLayerNames(Net<float> &net,
+                                                std::string pass) {
+  std::vector<const char*> names(net.layers().size());
+  for (unsigned int l = 0; l < names.size(); ++l) {
+    names[l] = Tracer::Get().Intern(net.layer_names()[l] + " " + pass);
+  }
+  return names;
+}
+
+// Raw samples [ms] of the layer wise and whole net passes
+struct NetTimings {
+  std::vector<std::vector<double>> layer_forward;
+  std::vector<std::vector<double>> layer_backward;
+  std::vector<double> total_forward;
+  std::vector<double> total_backward;
+  // Performance counters of the layer wise passes
+  std::vector<PerfCounts> layer_forward_perf;
+  std::vector<PerfCounts> layer_backward_perf;
+};
+
+static NetTimings TimeNet(Net<float> &net, shared_ptr<Layer<float>> data_layer,
+                          shared_ptr<Layer<float>> label_layer, int num_output,
+                          bool backward, int warmup_runs, int bench_runs,
+                          PerfCounters *perf = nullptr) {
+  NetTimings timings;
+  timings.layer_forward.resize(net.layers().size());
+  timings.layer_backward.resize(net.layers().size());
+  timings.layer_forward_perf.resize(net.layers().size());
+  timings.layer_backward_perf.resize(net.layers().size());
+
+  std::vector<const char*> trace_forward = TraceLayerNames(net, "forward");
+  std::vector<const char*> trace_backward = TraceLayerNames(net, "backward");
+
+  std::chrono::time_point<std::chrono::high_resolution_clock> t_start, t_end;
+  double tmp_time = 0;
+
+  for (int run = 0; run < warmup_runs + bench_runs; ++run) {
+    FillNet(data_layer, label_layer, num_output);
+
+    tmp_time = 0;
+
+    // Benchmark 1: Layer wise measurements (forward)
+    for (int_tp l = 0; l < net.layers().size(); ++l) {
+      TraceScope trace(trace_forward[l]);
+      {
+        // Counter reads outside of the timed window
+        PerfScope scope(perf, run >= warmup_runs ?
+            &timings.layer_forward_perf[l] : nullptr);
+        t_start = std::chrono::high_resolution_clock::now();
+        net.ForwardFromTo(l, l);
+        Caffe::Synchronize(net.layers()[l]->get_device()->list_id());
+        t_end = std::chrono::high_resolution_clock::now();
+      }
+      tmp_time += (t_end - t_start).count();
+      if (run >= warmup_runs) {
+        timings.layer_forward[l].push_back((t_end - t_start).count() / 1e6);
+      }
+    }
+    LOG(INFO) << "Forward pass: " << std::setprecision(10)
+        << (tmp_time)/((double)1e6) << " ms";
+
+    if (!backward) {
+      continue;
+    }
+
+    tmp_time = 0;
+
+    // Benchmark 2: Layer wise measurements (backward)
+    for (int_tp l = net.layers().size() - 1; l >= 0; --l) {
+      TraceScope trace(trace_backward[l]);
+      {
+        PerfScope scope(perf, run >= warmup_runs ?
+            &timings.layer_backward_perf[l] : nullptr);
+        t_start = std::chrono::high_resolution_clock::now();
+        net.BackwardFromTo(l, l);
+        Caffe::Synchronize(net.layers()[l]->get_device()->list_id());
+        t_end = std::chrono::high_resolution_clock::now();
+      }
+      tmp_time += (t_end - t_start).count();
+      if (run >= warmup_runs) {
+        timings.layer_backward[l].push_back((t_end - t_start).count() / 1e6);
+      }
+    }
+    LOG(INFO) << "Backward pass: " << std::setprecision(10)
+        << (tmp_time)/((double)1e6) << " ms";
+  }
+
+  for (int run = 0; run < warmup_runs + bench_runs; ++run) {
+    FillNet(data_layer, label_layer, num_output);
+
+    // Benchmark 3: Whole forward pass
+    t_start = std::chrono::high_resolution_clock::now();
+    net.ForwardPrefilled();
+    Caffe::Synchronize(
+        net.layers()[net.layers().size() - 1]->get_device()->list_id());
+    t_end = std::chrono::high_resolution_clock::now();
+    LOG(INFO) << "Forward pass: " << std::setprecision(10)
+        << (double)((t_end - t_start).count())/((double)1e6) << " ms";
+    if (run >= warmup_runs) {
+      timings.total_forward.push_back((t_end - t_start).count() / 1e6);
+    }
+
+    if (!backward) {
+      continue;
+    }
+
+    // Benchmark 4: Whole backward pass
+    t_start = std::chrono::high_resolution_clock::now();
+    net.Backward();
+    Caffe::Synchronize(net.layers()[0]->get_device()->list_id());
+    t_end = std::chrono::high_resolution_clock::now();
+    LOG(INFO) << "Backward pass: " << std::setprecision(10)
+        << (double)((t_end - t_start).count())/((double)1e6) << " ms";
+    if (run >= warmup_runs) {
+      timings.total_backward.push_back((t_end - t_start).count() / 1e6);
+    }
+  }
+
+  return timings;
+}
+
+// Activation (top blobs) and parameter footprint per layer [bytes], with
+// the running total of the activations up to the layer
+static void WriteLayerMemory(Net<float> &net, bofs::path filep) {
+  std::ofstream out_file;
+  out_file.open(filep.string());
+  assert(out_file.is_open());
+
+  std::vector<std::string> layers = net.layer_names();
+  long total = 0;
+  for (int l = 0; l < net.layers().size(); ++l) {
+    long top_bytes = 0;
+    for (unsigned int i = 0; i < net.top_vecs()[l].size(); ++i) {
+      top_bytes += net.top_vecs()[l][i]->count() * sizeof(float);
+    }
+    long param_bytes = 0;
+    for (unsigned int i = 0; i < net.layers()[l]->blobs().size(); ++i) {
+      param_bytes += net.layers()[l]->blobs()[i]->count() * sizeof(float);
+    }
+    total += top_bytes;
+    out_file << l << ";" << layers[l] << ";" << top_bytes << ";"
+             << param_bytes << ";" << total << std::endl;
+  }
+  out_file.close();
+}
+
+// Sets the batch size (if > 0) and the spatial size of all memory data
+// layers: tile_size for labels, tile_size + padding for images (the
+// difference of the original size to patch_size is kept)
+static void ReshapeMemoryData(NetParameter &param, int patch_size,
+                              int batch_size, int tile_size) {
+  for (int i = 0; i < param.layer_size(); ++i) {
+    caffe::LayerParameter *layer_param = param.mutable_layer(i);
+    if (layer_param->type() != "MemoryData") {
+      continue;
+    }
+    caffe::MemoryDataParameter *data_param =
+        layer_param->mutable_memory_data_param();
+    if (batch_size > 0) {
+      data_param->set_batch_size(batch_size);
+    }
+    int border = (int) data_param->height() - patch_size;
+    data_param->set_height(tile_size + border);
+    data_param->set_width(tile_size + border);
+  }
+}
+
+struct SweepResult {
+  std::string net;
+  int threads;
+  int batch_size;
+  int tile_size;
+  double forward;
+  double backward;
+  double pixel_rate;
+};
+
+// Whole and layer wise timings of the train and process nets over all
+// combinations of thread count, batch size and tile size
+static void BenchmarkSweep(SweepBenchParam &sweep_param,
+                           BenchmarkParam &benchmark_param,
+                           TrainParam &train_param,
+                           ProcessParam &process_param, int warmup_runs,
+                           int bench_runs, bofs::path benchpath) {
+  int max_threads = omp_get_max_threads();
+  std::vector<int> threads(sweep_param.threads().begin(),
+                           sweep_param.threads().end());
+  if (threads.size() == 0) {
+    threads.push_back(max_threads);
+  }
+  std::vector<int> batch_sizes(sweep_param.batch_size().begin(),
+                               sweep_param.batch_size().end());
+  if (batch_sizes.size() == 0) {
+    batch_sizes.push_back(0);
+  }
+
+  // Net prototxt, phase and the patch size they are declared for
+  std::vector<std::string> names;
+  std::vector<NetParameter> net_params;
+  std::vector<int> patch_sizes;
+  if (benchmark_param.has_train_index()) {
+    caffe::SolverParameter solver_param;
+    caffe::ReadProtoFromTextFileOrDie(train_param.solver(), &solver_param);
+    NetParameter net_param;
+    caffe::ReadNetParamsFromTextFileOrDie(
+        solver_param.has_net() ? solver_param.net() : solver_param.train_net(),
+        &net_param);
+    net_param.mutable_state()->set_phase(caffe::TRAIN);
+    names.push_back("train");
+    net_params.push_back(net_param);
+    patch_sizes.push_back(train_param.input().patch_size());
+  }
+  if (benchmark_param.has_process_index()) {
+    NetParameter net_param;
+    caffe::ReadNetParamsFromTextFileOrDie(process_param.process_net(),
+                                          &net_param);
+    net_param.mutable_state()->set_phase(caffe::TEST);
+    names.push_back("process");
+    net_params.push_back(net_param);
+    patch_sizes.push_back(process_param.input().patch_size());
+  }
+
+  bofs::path layersp = benchpath;
+  layersp /= ("/sweep_layers_timings.csv");
+  std::ofstream layers_file;
+  layers_file.open(layersp.string());
+  assert(layers_file.is_open());
+
+  std::vector<SweepResult> results;
+
+  for (unsigned int t = 0; t < threads.size(); ++t) {
+    omp_set_num_threads(threads[t]);
+    for (unsigned int b = 0; b < batch_sizes.size(); ++b) {
+      for (unsigned int n = 0; n < net_params.size(); ++n) {
+        std::vector<int> tile_sizes(sweep_param.tile_size().begin(),
+                                    sweep_param.tile_size().end());
+        if (tile_sizes.size() == 0) {
+          tile_sizes.push_back(patch_sizes[n]);
+        }
+        for (unsigned int k = 0; k < tile_sizes.size(); ++k) {
+          NetParameter net_param = net_params[n];
+          ReshapeMemoryData(net_param, patch_sizes[n], batch_sizes[b],
+                            tile_sizes[k]);
+          Net<float> net(net_param, Caffe::GetDefaultDevice());
+
+          bool train = (names[n] == "train");
+          NetTimings timings = TimeNet(
+              net, net.layers()[train ? 1 : 0],
+              train ? net.layers()[0] : NULL, train_param.input().labels(),
+              train, warmup_runs, bench_runs);
+
+          // Batch size as actually instantiated
+          int batch_size = net.layers()[0]->layer_param()
+              .memory_data_param().batch_size();
+
+          SweepResult result;
+          result.net = names[n];
+          result.threads = threads[t];
+          result.batch_size = batch_size;
+          result.tile_size = tile_sizes[k];
+          result.forward = ComputeStats(timings.total_forward).median;
+          result.backward = ComputeStats(timings.total_backward).median;
+          result.pixel_rate = (double) batch_size * tile_sizes[k]
+              * tile_sizes[k] / ((result.forward + result.backward) / 1e3);
+          results.push_back(result);
+
+          LOG(INFO) << "Sweep (" << result.net << ", " << result.threads
+              << " threads, batch " << batch_size << ", tile "
+              << result.tile_size << "): " << result.pixel_rate
+              << " pixels/s";
+
+          std::vector<std::string> layers = net.layer_names();
+          for (int l = 0; l < net.layers().size(); ++l) {
+            layers_file << result.net << ";" << result.threads << ";"
+                << batch_size << ";" << result.tile_size << ";" << l << ";"
+                << layers[l] << ";" << std::setprecision(10)
+                << ComputeStats(timings.layer_forward[l]).median << ";"
+                << ComputeStats(timings.layer_backward[l]).median
+                << std::endl;
+          }
+        }
+      }
+    }
+  }
+  layers_file.close();
+  omp_set_num_threads(max_threads);
+
+  // Parallel efficiency relative to the first thread count
+  bofs::path filep = benchpath;
+  filep /= ("/sweep_scaling.csv");
+  std::ofstream out_file;
+  out_file.open(filep.string());
+  assert(out_file.is_open());
+  for (unsigned int i = 0; i < results.size(); ++i) {
+    SweepResult &result = results[i];
+    double efficiency = 0;
+    for (unsigned int j = 0; j < results.size(); ++j) {
+      SweepResult &reference = results[j];
+      if (reference.threads == threads[0] && reference.net == result.net
+          && reference.batch_size == result.batch_size
+          && reference.tile_size == result.tile_size) {
+        efficiency = (result.pixel_rate / reference.pixel_rate)
+            * ((double) reference.threads / result.threads);
+        break;
+      }
+    }
+    out_file << result.net << ";" << result.threads << ";"
+             << result.batch_size << ";" << result.tile_size << ";"
+             << std::setprecision(10) << result.forward << ";"
+             << result.backward << ";" << result.pixel_rate << ";"
+             << efficiency << std::endl;
+  }
+  out_file.close();
+}
+
+// Process() on a generated image stack, timed per stage over all slices
+static void BenchmarkEndToEnd(EndToEndBenchParam &e2e_param,
+                              ProcessParam &process_param, int warmup_runs,
+                              int bench_runs, bofs::path benchpath,
+                              BenchmarkReport &report) {
+  InputParam input_param = process_param.input();
+  OutputParam output_param = process_param.output();
+
+  if(!(input_param.has_patch_size() && input_param.has_padding_size() && input_param.has_labels() && input_param.has_channels())) {
+    LOG(FATAL) << "Patch size, padding size, label count or channel count parameter missing.";
+  }
+  int patch_size = input_param.patch_size();
+  int padding_size = input_param.padding_size();
+  unsigned int nr_labels = input_param.labels();
+  int channels = e2e_param.has_channels() ?
+      e2e_param.channels() : input_param.channels();
+  int width = e2e_param.width();
+  int height = e2e_param.height();
+  int pages = e2e_param.pages();
+  bool fp32out = output_param.has_fp32_out() ? output_param.fp32_out() : false;
+
+  Net<float> net(process_param.process_net(), caffe::TEST,
+                 Caffe::GetDefaultDevice());
+  if (process_param.has_caffemodel()) {
+    net.CopyTrainedLayersFrom(process_param.caffemodel());
+  }
+
+  ProcessImageProcessor image_processor(patch_size, nr_labels);
+  MemoryDataBuffer input_buffer(net.layers()[0]);
+  int imagecrop = SetupProcessImageProcessor(image_processor, input_param);
+
+  unsigned int nr_out_labels = ((output_param.has_out_all_labels() && output_param.out_all_labels()) || nr_labels > 2)?nr_labels:1;
+  unsigned int label_offset = nr_out_labels==1?1:0;
+
+  bofs::path e2epath = benchpath / "end_to_end";
+  bofs::create_directories(e2epath);
+  std::string outfile = (e2epath / "output.tif").string();
+
+  uint64_t seed = GetTimeSeed();
+  std::vector<cv::Mat> image_stack(pages);
+  for (int p = 0; p < pages; ++p) {
+    cv::Mat noise(height, width, CV_32FC(channels));
+    FillUniform(noise, seed, p, 0.0, 256.0);
+    noise.convertTo(image_stack[p], CV_8UC(channels));
+  }
+
+  PipelineStats stats;
+  std::vector<std::string> stages = { "preprocess", "tile_input", "forward",
+      "scatter", "tiles", "save", "total" };
+  for (unsigned int s = 0; s < stages.size(); ++s) {
+    stats.AddStage(stages[s]);
+  }
+  std::vector<std::vector<double>> samples(stages.size());
+
+  for (int run = 0; run < warmup_runs + bench_runs; ++run) {
+    std::vector<double> run_start(stages.size());
+    for (unsigned int s = 0; s < stages.size(); ++s) {
+      run_start[s] = stats.Total(s);
+    }
+
+    {
+      StageTimer total_timer(&stats, 6);
+      std::vector<cv::Mat> output_stack(pages);
+      for (int p = 0; p < pages; ++p) {
+        image_processor.ClearImages();
+        std::vector<cv::Mat> labels;
+        {
+          StageTimer timer(&stats, 0);
+          image_processor.SubmitImage(image_stack[p], p, labels);
+        }
+
+        // Label images are allocated directly in the output format
+        cv::Mat padimage = image_processor.raw_images()[0];
+        std::vector<cv::Mat> outimgs;
+        {
+          StageTimer timer(&stats, 4);
+          for (unsigned int k = 0; k < nr_out_labels; ++k) {
+            outimgs.push_back(cv::Mat(height, width, fp32out?CV_32FC1:CV_8UC1));
+          }
+          ProcessTiles(net, input_buffer, padimage, patch_size, padding_size,
+                       imagecrop, label_offset, fp32out ? 1.0 : 255.0,
+                       outimgs, nullptr, &stats);
+        }
+        output_stack[p] = outimgs[0];
+      }
+
+      {
+        StageTimer timer(&stats, 5);
+        SaveTiff(output_stack, outfile);
+      }
+    }
+
+    if (run >= warmup_runs) {
+      for (unsigned int s = 0; s < stages.size(); ++s) {
+        samples[s].push_back((stats.Total(s) - run_start[s]) * 1e3);
+      }
+    }
+  }
+
+  if (!e2e_param.keep_files()) {
+    bofs::remove(outfile);
+  }
+
+  // Throughput in megapixels (all slices) per second of stage time
+  double megapixels = (double) width * height * pages / 1e6;
+
+  bofs::path filep = benchpath;
+  filep /= ("/end_to_end_timings.csv");
+  std::ofstream out_file;
+  out_file.open(filep.string());
+  assert(out_file.is_open());
+
+  for (unsigned int s = 0; s < stages.size(); ++s) {
+    SampleStats sample_stats = ComputeStats(samples[s]);
+    double mp_rate = megapixels / (sample_stats.median / 1e3);
+    LOG(INFO) << "End to end " << stages[s] << ": " << std::setprecision(10)
+              << sample_stats.median << " ms, " << mp_rate << " MP/s";
+    out_file << stages[s] << ";" << std::setprecision(10)
+             << sample_stats.mean;
+    WriteStats(out_file, sample_stats);
+    out_file << ";" << mp_rate << std::endl;
+    report.Add("end_to_end", stages[s], samples[s]);
+  }
+  out_file.close();
+}
+
 int Benchmark(ToolParam &tool_param, CommonSettings &settings) {
 
   BenchmarkParam benchmark_param = tool_param.benchmark(settings.param_index);
@@ -102,8 +910,6 @@ int Benchmark(ToolParam &tool_param, CommonSettings &settings) {
 
   }
 
-  double tmp_time = 0;
-
   // Create output directories
   bofs::path benchpath(benchmark_param.output());
   bofs::create_directories(benchpath);
@@ -111,10 +917,47 @@ int Benchmark(ToolParam &tool_param, CommonSettings &settings) {
   std::string proto_solver = train_param.solver();
   std::string process_net = process_param.process_net();
 
-  std::chrono::time_point<std::chrono::high_resolution_clock> t_start, t_end;
+  BenchmarkReport report;
+
+  // Machine peak for the roofline columns of the layer timings
+  bool roofline = benchmark_param.roofline()
+      && (benchmark_param.has_train_index()
+          || benchmark_param.has_process_index());
+  MachinePeak peak = { 0, 0 };
+  if (roofline) {
+    peak = MeasureMachinePeak();
+
+    bofs::path filep = benchpath;
+    filep /= ("/machine_peak.csv");
+
+    std::ofstream out_file;
+    out_file.open(filep.string());
+    assert(out_file.is_open());
+    out_file << "GFLOP/s;" << std::setprecision(10) << peak.gflops
+             << std::endl;
+    out_file << "GB/s;" << peak.bandwidth << std::endl;
+    out_file.close();
+  }
+
+  PerfCounters perf;
+  if (benchmark_param.perf_counters() && perf.Open()) {
+    bofs::path filep = benchpath;
+    filep /= ("/perf_counters.csv");
+
+    std::ofstream out_file;
+    out_file.open(filep.string());
+    assert(out_file.is_open());
+    std::vector<std::string> columns = perf.columns();
+    for (unsigned int e = 0; e < columns.size(); ++e) {
+      out_file << (e > 0 ? ";" : "") << columns[e];
+    }
+    out_file << std::endl;
+    out_file.close();
+  }
 
   // Benchmark block 1: Training Net
   if (benchmark_param.has_train_index()) {
+    MemoryPhase phase("train_net");
     caffe::SolverParameter solver_param;
     caffe::ReadProtoFromTextFileOrDie(proto_solver, &solver_param);
     shared_ptr<caffe::Solver<float> >
@@ -122,75 +965,9 @@ int Benchmark(ToolParam &tool_param, CommonSettings &settings) {
     boost::shared_ptr<caffe::Net<float>> net = solver->net();
     net->layers()[0L]->get_device()->ResetPeakMemoryUsage();
 
-    std::vector<double> layer_forward_times(net->layers().size());
-    std::vector<double> layer_backward_times(net->layers().size());
-
-    double total_forward_time = 0;
-    double total_backward_time = 0;
-
-    for (int run = 0; run < warmup_runs + bench_runs; ++run) {
-      FillNet(net->layers()[1], net->layers()[0], train_param.input().labels());
-
-      tmp_time = 0;
-
-      // Benchmark 1: Layer wise measurements (forward)
-      for (int_tp l = 0; l < net->layers().size(); ++l) {
-        t_start = std::chrono::high_resolution_clock::now();
-        net->ForwardFromTo(l, l);
-        Caffe::Synchronize(net->layers()[l]->get_device()->list_id());
-        t_end = std::chrono::high_resolution_clock::now();
-        tmp_time += (t_end - t_start).count();
-        if (run >= warmup_runs) {
-          layer_forward_times[l] += (t_end - t_start).count();
-        }
-      }
-      LOG(INFO) << "Forward pass: " << std::setprecision(10)
-          << (tmp_time)/((double)1e6) << " ms";
-
-      tmp_time = 0;
-
-      // Benchmark 2: Layer wise measurements (backward)
-      for (int_tp l = net->layers().size() - 1; l >= 0; --l) {
-        t_start = std::chrono::high_resolution_clock::now();
-        net->BackwardFromTo(l, l);
-        Caffe::Synchronize(net->layers()[l]->get_device()->list_id());
-        t_end = std::chrono::high_resolution_clock::now();
-        tmp_time += (t_end - t_start).count();
-        if (run >= warmup_runs) {
-          layer_backward_times[l] += (t_end - t_start).count();
-        }
-      }
-      LOG(INFO) << "Backward pass: " << std::setprecision(10)
-          << (tmp_time)/((double)1e6) << " ms";
-
-    }
-
-    for (int run = 0; run < warmup_runs + bench_runs; ++run) {
-      FillNet(net->layers()[1], net->layers()[0], train_param.input().labels());
-
-      // Benchmark 3: Whole forward pass
-      t_start = std::chrono::high_resolution_clock::now();
-      net->ForwardPrefilled();
-      Caffe::Synchronize(
-          net->layers()[net->layers().size() - 1]->get_device()->list_id());
-      t_end = std::chrono::high_resolution_clock::now();
-      LOG(INFO) << "Forward pass: " << std::setprecision(10)
-          << (double)((t_end - t_start).count())/((double)1e6) << " ms";
-      if (run >= warmup_runs) {
-        total_forward_time += (t_end - t_start).count();
-      }
-
-      // Benchmark 4: Whole backward pass
-      t_start = std::chrono::high_resolution_clock::now();
-      net->Backward();
-      Caffe::Synchronize(net->layers()[0]->get_device()->list_id());
-      t_end = std::chrono::high_resolution_clock::now();
-      LOG(INFO) << "Backward pass: " << std::setprecision(10)
-          << (double)((t_end - t_start).count())/((double)1e6) << " ms";
-      if (run >= warmup_runs) {
-        total_backward_time += (t_end - t_start).count();
-      }
-    }
+    NetTimings timings = TimeNet(*net, net->layers()[1], net->layers()[0],
+                                 train_param.input().labels(), true,
+                                 warmup_runs, bench_runs, &perf);
 
     // Write outputs
     std::vector<std::string> layers = net->layer_names();
@@ -203,11 +980,21 @@ int Benchmark(ToolParam &tool_param, CommonSettings &settings) {
       out_file.open(filep.string());
       assert(out_file.is_open());
       for (int l = 0; l < net->layers().size(); ++l) {
+        SampleStats stats = ComputeStats(timings.layer_forward[l]);
         out_file << l << ";" << layers[l] << ";"
                  << std::setprecision(10)
-                 << layer_forward_times[l] / ((double) bench_runs * 1e6)
-                 << ";" << net->layers()[l]->ForwardFlops()
-                 << std::endl;
+                 << stats.mean
+                 << ";" << net->layers()[l]->ForwardFlops();
+        WriteStats(out_file, stats);
+        if (roofline) {
+          WriteRoofline(out_file, net->layers()[l]->ForwardFlops(),
+                        LayerForwardBytes(*net, l), stats.median, peak);
+        }
+        if (perf.enabled()) {
+          WritePerfCounts(out_file, perf, timings.layer_forward_perf[l]);
+        }
+        out_file << std::endl;
+        report.Add("train_forward_layers", layers[l], timings.layer_forward[l]);
       }
       out_file.close();
     }
@@ -220,11 +1007,21 @@ int Benchmark(ToolParam &tool_param, CommonSettings &settings) {
       out_file.open(filep.string());
       assert(out_file.is_open());
       for (int l = 0; l < net->layers().size(); ++l) {
+        SampleStats stats = ComputeStats(timings.layer_backward[l]);
         out_file << l << ";" << layers[l] << ";"
                  << std::setprecision(10)
-                 << layer_backward_times[l] / ((double) bench_runs * 1e6)
-                 << ";" << net->layers()[l]->BackwardFlops()
-                 << std::endl;
+                 << stats.mean
+                 << ";" << net->layers()[l]->BackwardFlops();
+        WriteStats(out_file, stats);
+        if (roofline) {
+          WriteRoofline(out_file, net->layers()[l]->BackwardFlops(),
+                        LayerBackwardBytes(*net, l), stats.median, peak);
+        }
+        if (perf.enabled()) {
+          WritePerfCounts(out_file, perf, timings.layer_backward_perf[l]);
+        }
+        out_file << std::endl;
+        report.Add("train_backward_layers", layers[l], timings.layer_backward[l]);
       }
       out_file.close();
     }
@@ -238,12 +1035,16 @@ int Benchmark(ToolParam &tool_param, CommonSettings &settings) {
       assert(out_file.is_open());
 
       out_file << "Forward;" << std::setprecision(10)
-               << total_forward_time / ((double) bench_runs * 1e6)
-               << std::endl;
+               << ComputeStats(timings.total_forward).mean;
+      WriteStats(out_file, ComputeStats(timings.total_forward));
+      out_file << std::endl;
+      report.Add("train_total", "Forward", timings.total_forward);
 
       out_file << "Backward;" << std::setprecision(10)
-               << total_backward_time / ((double) bench_runs * 1e6)
-               << std::endl;
+               << ComputeStats(timings.total_backward).mean;
+      WriteStats(out_file, ComputeStats(timings.total_backward));
+      out_file << std::endl;
+      report.Add("train_total", "Backward", timings.total_backward);
       out_file.close();
     }
 
@@ -264,50 +1065,19 @@ int Benchmark(ToolParam &tool_param, CommonSettings &settings) {
       out_file.close();
     }
 
+    WriteLayerMemory(*net, benchpath / "train_layer_memory.csv");
+
   }
 
   // Benchmark block 2: Processing Net
   if (benchmark_param.has_process_index()) {
+    MemoryPhase phase("process_net");
     Net<float> net(process_net, caffe::TEST, Caffe::GetDefaultDevice());
     net.layers()[0]->get_device()->ResetPeakMemoryUsage();
 
-    std::vector<double> layer_forward_times(net.layers().size());
-    double total_forward_time = 0;
-
-    // Benchmark 1: Layer wise measurements (forward)
-    for (int run = 0; run < warmup_runs + bench_runs; ++run) {
-      FillNet(net.layers()[0], NULL, train_param.input().labels());
-
-      tmp_time = 0;
-      // Benchmark 1: Layer wise measurements (forward)
-      for (int l = 0; l < net.layers().size(); ++l) {
-        t_start = std::chrono::high_resolution_clock::now();
-        net.ForwardFromTo(l, l);
-        Caffe::Synchronize(net.layers()[l]->get_device()->list_id());
-        t_end = std::chrono::high_resolution_clock::now();
-        tmp_time += (t_end - t_start).count();
-        if (run >= warmup_runs) {
-          layer_forward_times[l] += (t_end - t_start).count();
-        }
-      }
-      LOG(INFO) << "Forward pass: " << std::setprecision(10)
-          << (tmp_time)/((double)1e6) << " ms";
-    }
-
-    // Benchmark 2: Whole forward pass
-    for (int run = 0; run < warmup_runs + bench_runs; ++run) {
-      FillNet(net.layers()[0], NULL, train_param.input().labels());
-      t_start = std::chrono::high_resolution_clock::now();
-      net.ForwardPrefilled();
-      Caffe::Synchronize(
-          net.layers()[net.layers().size() - 1]->get_device()->list_id());
-      t_end = std::chrono::high_resolution_clock::now();
-      LOG(INFO) << "Forward pass: " << std::setprecision(10)
-          << (double)((t_end - t_start).count())/((double)1e6) << " ms";
-      if (run >= warmup_runs) {
-        total_forward_time += (t_end - t_start).count();
-      }
-    }
+    NetTimings timings = TimeNet(net, net.layers()[0], NULL,
+                                 train_param.input().labels(), false,
+                                 warmup_runs, bench_runs, &perf);
 
     // Write outputs
     std::vector<std::string> layers = net.layer_names();
@@ -320,11 +1090,21 @@ int Benchmark(ToolParam &tool_param, CommonSettings &settings) {
       out_file.open(filep.string());
       assert(out_file.is_open());
       for (int l = 0; l < net.layers().size(); ++l) {
+        SampleStats stats = ComputeStats(timings.layer_forward[l]);
         out_file << l << ";" << layers[l] << ";"
                  << std::setprecision(10)
-                 << layer_forward_times[l] / ((double) bench_runs * 1e6)
-                 << ";" << net.layers()[l]->ForwardFlops()
-                 << std::endl;
+                 << stats.mean
+                 << ";" << net.layers()[l]->ForwardFlops();
+        WriteStats(out_file, stats);
+        if (roofline) {
+          WriteRoofline(out_file, net.layers()[l]->ForwardFlops(),
+                        LayerForwardBytes(net, l), stats.median, peak);
+        }
+        if (perf.enabled()) {
+          WritePerfCounts(out_file, perf, timings.layer_forward_perf[l]);
+        }
+        out_file << std::endl;
+        report.Add("process_forward_layers", layers[l], timings.layer_forward[l]);
       }
       out_file.close();
     }
@@ -338,8 +1118,10 @@ int Benchmark(ToolParam &tool_param, CommonSettings &settings) {
       assert(out_file.is_open());
 
       out_file << "Forward;" << std::setprecision(10)
-               << total_forward_time / ((double) bench_runs * 1e6)
-               << std::endl;
+               << ComputeStats(timings.total_forward).mean;
+      WriteStats(out_file, ComputeStats(timings.total_forward));
+      out_file << std::endl;
+      report.Add("process_total", "Forward", timings.total_forward);
       out_file.close();
     }
 
@@ -359,6 +1141,51 @@ int Benchmark(ToolParam &tool_param, CommonSettings &settings) {
       }
       out_file.close();
     }
+
+    WriteLayerMemory(net, benchpath / "process_layer_memory.csv");
+  }
+
+  // Benchmark block 3: Data pipeline (preprocessing and augmentation)
+  if (benchmark_param.has_pipeline()) {
+    MemoryPhase phase("pipeline");
+    PipelineBenchParam pipeline_param = benchmark_param.pipeline();
+    InputParam input_param = train_param.input();
+    BenchmarkPipeline(pipeline_param, input_param, warmup_runs, benchpath,
+                      &perf);
+  }
+
+  // Benchmark block 4: Image I/O throughput
+  if (benchmark_param.has_io()) {
+    MemoryPhase phase("io");
+    IOBenchParam io_param = benchmark_param.io();
+    BenchmarkIO(io_param, warmup_runs, bench_runs, benchpath);
+  }
+
+  // Benchmark block 5: Batch size, tile size and thread count sweep
+  if (benchmark_param.has_sweep()) {
+    MemoryPhase phase("sweep");
+    SweepBenchParam sweep_param = benchmark_param.sweep();
+    BenchmarkSweep(sweep_param, benchmark_param, train_param, process_param,
+                   warmup_runs, bench_runs, benchpath);
+  }
+
+  // Benchmark block 6: End to end processing of a synthetic image
+  if (benchmark_param.has_end_to_end()) {
+    MemoryPhase phase("end_to_end");
+    EndToEndBenchParam e2e_param = benchmark_param.end_to_end();
+    BenchmarkEndToEnd(e2e_param, process_param, warmup_runs, bench_runs,
+                      benchpath, report);
+  }
+
+  if (benchmark_param.json()) {
+    report.WriteJSON((benchpath / "benchmark.json").string());
+  }
+
+  if (benchmark_param.has_baseline()) {
+    int regressions = report.CompareBaseline(
+        benchmark_param.baseline(), benchmark_param.regression_threshold(),
+        (benchpath / "regressions.csv").string());
+    return regressions > 0 ? 1 : 0;
   }
 
   return 0;
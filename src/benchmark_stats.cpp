@@ -0,0 +1,152 @@
+/*
+ * benchmark_stats.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "benchmark_stats.hpp"
+#include <glog/logging.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+namespace caffe_neural {
+
+SampleStats ComputeStats(std::vector<double> samples) {
+  SampleStats stats = { 0, 0, 0, 0, 0, 0 };
+  if (samples.size() == 0) {
+    return stats;
+  }
+  std::sort(samples.begin(), samples.end());
+
+  long n = samples.size();
+  double sum = 0;
+  for (long i = 0; i < n; ++i) {
+    sum += samples[i];
+  }
+  stats.mean = sum / n;
+
+  double sqsum = 0;
+  for (long i = 0; i < n; ++i) {
+    sqsum += (samples[i] - stats.mean) * (samples[i] - stats.mean);
+  }
+  stats.stddev = n > 1 ? std::sqrt(sqsum / (n - 1)) : 0;
+
+  auto percentile = [&](double q) {
+    long rank = (long) std::ceil(q * n);
+    return samples[std::max(rank, 1L) - 1];
+  };
+  stats.min = samples[0];
+  stats.median = percentile(0.5);
+  stats.p90 = percentile(0.9);
+  stats.p99 = percentile(0.99);
+  return stats;
+}
+
+void WriteStats(std::ostream &out, const SampleStats &stats) {
+  out << ";" << stats.min << ";" << stats.median << ";" << stats.p90 << ";"
+      << stats.p99 << ";" << stats.stddev;
+}
+
+void BenchmarkReport::Add(std::string section, std::string name,
+                          const std::vector<double> &samples) {
+  Entry entry;
+  entry.section = section;
+  entry.name = name;
+  entry.samples = samples;
+  entry.stats = ComputeStats(samples);
+  entries_.push_back(entry);
+}
+
+void BenchmarkReport::WriteJSON(std::string file) {
+  std::ofstream out_file(file, std::ios::out);
+  if (!out_file.is_open()) {
+    LOG(ERROR) << "Could not write benchmark report: " << file;
+    return;
+  }
+
+  out_file << std::setprecision(10) << "{";
+  std::string section;
+  for (unsigned int i = 0; i < entries_.size(); ++i) {
+    Entry &entry = entries_[i];
+    if (entry.section != section) {
+      out_file << (i > 0 ? "]," : "") << "\n\"" << entry.section << "\":[";
+      section = entry.section;
+    } else {
+      out_file << ",";
+    }
+    out_file << "\n{\"name\":\"" << entry.name << "\",\"mean\":"
+             << entry.stats.mean << ",\"min\":" << entry.stats.min
+             << ",\"median\":" << entry.stats.median << ",\"p90\":"
+             << entry.stats.p90 << ",\"p99\":" << entry.stats.p99
+             << ",\"stddev\":" << entry.stats.stddev << ",\"samples\":[";
+    for (unsigned int k = 0; k < entry.samples.size(); ++k) {
+      out_file << (k > 0 ? "," : "") << entry.samples[k];
+    }
+    out_file << "]}";
+  }
+  out_file << (entries_.size() > 0 ? "]" : "") << "\n}" << std::endl;
+}
+
+// Baseline medians by name from a layer (index;name;mean;flops;min;median)
+// or total (name;mean;min;median) timings CSV, the mean for older outputs
+static std::map<std::string, double> LoadBaseline(std::string file,
+                                                  bool layers) {
+  std::map<std::string, double> baseline;
+  std::ifstream in_file(file);
+  std::string line;
+  while (std::getline(in_file, line)) {
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, ';')) {
+      fields.push_back(field);
+    }
+    if (layers && fields.size() >= 3) {
+      baseline[fields[1]] = std::stod(fields[fields.size() >= 9 ? 5 : 2]);
+    } else if (!layers && fields.size() >= 2) {
+      baseline[fields[0]] = std::stod(fields[fields.size() >= 7 ? 3 : 1]);
+    }
+  }
+  return baseline;
+}
+
+int BenchmarkReport::CompareBaseline(std::string baseline_folder,
+                                     double threshold,
+                                     std::string output_file) {
+  std::ofstream out_file(output_file, std::ios::out);
+  std::map<std::string, std::map<std::string, double>> baselines;
+  int regressions = 0;
+
+  for (unsigned int i = 0; i < entries_.size(); ++i) {
+    Entry &entry = entries_[i];
+    if (baselines.find(entry.section) == baselines.end()) {
+      bool layers = entry.section.find("_layers") != std::string::npos;
+      baselines[entry.section] = LoadBaseline(
+          baseline_folder + "/" + entry.section + "_timings.csv", layers);
+    }
+    std::map<std::string, double> &baseline = baselines[entry.section];
+    std::map<std::string, double>::iterator it = baseline.find(entry.name);
+    if (it == baseline.end() || it->second <= 0) {
+      continue;
+    }
+
+    double ratio = entry.stats.median / it->second;
+    if (ratio > 1.0 + threshold) {
+      ++regressions;
+      LOG(WARNING) << "Regression in " << entry.section << ", " << entry.name
+          << ": " << it->second << " ms -> " << entry.stats.median << " ms";
+      out_file << entry.section << ";" << entry.name << ";"
+               << std::setprecision(10) << it->second << ";"
+               << entry.stats.median << ";" << ratio << std::endl;
+    }
+  }
+
+  LOG(INFO) << "Baseline comparison: " << regressions << " regressions";
+  return regressions;
+}
+
+}  // namespace caffe_neural
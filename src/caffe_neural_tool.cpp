@@ -24,6 +24,9 @@
 #include "train.hpp"
 #include "process.hpp"
 #include "benchmark.hpp"
+#include "generate.hpp"
+#include "trace.hpp"
+#include "memory_profiler.hpp"
 
 namespace bopo = boost::program_options;
 namespace gpb = google::protobuf;
@@ -37,9 +40,18 @@ int main(int argc, const char** argv) {
   int device_id;
   int thread_count;
   std::string proto;
+  std::string trace_file;
+  std::string memprofile_file;
+  int memprofile_interval;
+  int exit_code = 0;
   int train_index;
   int process_index;
   int benchmark_index;
+  int generate_index;
+  std::string shard;
+  std::string claim_dir;
+  int claim_timeout;
+  int unit_pages;
 
   bopo::options_description desc("Allowed options");
   desc.add_options()      //
@@ -59,6 +71,24 @@ int main(int argc, const char** argv) {
    "process mode with process parameter set")  //
   ("silent", "silence all logging")  //
   ("benchmark", bopo::value<int>(&benchmark_index), "start a benchmarking run")  //
+  ("generate", bopo::value<int>(&generate_index),
+   "write a synthetic dataset with generate parameter set")  //
+  ("trace", bopo::value<std::string>(&trace_file),
+   "write a Chrome trace-event timeline (json)")  //
+  ("memprofile", bopo::value<std::string>(&memprofile_file),
+   "write a host memory timeline (csv)")  //
+  ("shard", bopo::value<std::string>(&shard),
+   "process only shard i of n (i/n, static partitioning)")  //
+  ("claims", bopo::value<std::string>(&claim_dir),
+   "claim work units dynamically in this shared folder")  //
+  ("claim_timeout", bopo::value<int>(&claim_timeout)->default_value(300),
+   "seconds without heartbeat until a claim of another host is retried")  //
+  ("unit_pages", bopo::value<int>(&unit_pages)->default_value(0),
+   "split multi-page TIFFs into work units of n pages")  //
+  ("resume", "continue an interrupted process run from its checkpoints")  //
+  ("memprofile_interval",
+   bopo::value<int>(&memprofile_interval)->default_value(100),
+   "memory sampling interval in ms")  //
    ;
 
   bopo::variables_map varmap;
@@ -95,6 +125,14 @@ int main(int argc, const char** argv) {
     Caffe::SetDevice(device_id);
   }
 
+  if (varmap.count("trace")) {
+    Tracer::Get().Start(trace_file);
+  }
+
+  if (varmap.count("memprofile")) {
+    MemoryProfiler::Get().Start(memprofile_file, memprofile_interval);
+  }
+
   if (varmap.count("proto")) {
 
     ToolParam tool_param;
@@ -103,11 +141,33 @@ int main(int argc, const char** argv) {
     CommonSettings settings;
     settings.graphic = varmap.count("graphic");
     settings.debug = varmap.count("debug");
+    settings.unit_pages = unit_pages;
+    settings.claim_timeout = claim_timeout;
+    settings.resume = varmap.count("resume");
+
+    if (varmap.count("shard")) {
+      if (sscanf(shard.c_str(), "%d/%d", &settings.shard_index,
+                 &settings.shard_count) != 2 || settings.shard_count < 1
+          || settings.shard_index < 0
+          || settings.shard_index >= settings.shard_count) {
+        LOG(FATAL) << "Invalid shard " << shard << ", expected i/n with 0 <= i < n.";
+      }
+    }
+
+    if (varmap.count("claims")) {
+      settings.claim_dir = claim_dir;
+    }
+
+    if (varmap.count("generate")) {
+      LOG(INFO)<< "Dataset generation mode.";
+      settings.param_index = generate_index;
+      Generate(tool_param, settings);
+    }
 
     if (varmap.count("benchmark")) {
       LOG(INFO)<< "Benchmarking mode.";
       settings.param_index = benchmark_index;
-      Benchmark(tool_param, settings);
+      exit_code = Benchmark(tool_param, settings);
     }
 
     if (varmap.count("train")) {
@@ -122,9 +182,12 @@ int main(int argc, const char** argv) {
       Process(tool_param, settings);
     }
 
+    Tracer::Get().Close();
+    MemoryProfiler::Get().Stop();
+
   } else {
     LOG(FATAL)<< "Missing prototxt argument.";
   }
 
-  return 0;
+  return exit_code;
 }
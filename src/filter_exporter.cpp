@@ -0,0 +1,235 @@
+/*
+ * filter_exporter.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "filter_exporter.hpp"
+#include "tiffio_wrapper.hpp"
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdint.h>
+
+namespace caffe_neural {
+
+std::vector<BlobCopy> CopyBlobs(Net<float> *net, std::set<std::string> &blobs,
+                                std::set<int> &channels, bool store_diff) {
+  std::vector<std::string> names = net->blob_names();
+  std::vector<boost::shared_ptr<Blob<float>>> net_blobs = net->blobs();
+
+  std::vector<BlobCopy> copies;
+  for (unsigned int i = 0; i < names.size(); ++i) {
+    if (blobs.size() > 0 && blobs.find(names[i]) == blobs.end()) {
+      continue;
+    }
+    shared_ptr<Blob<float>> blob = net_blobs[i];
+
+    BlobCopy copy;
+    copy.name = names[i];
+    copy.num = blob->num();
+    copy.height = blob->height();
+    copy.width = blob->width();
+    for (int c = 0; c < blob->channels(); ++c) {
+      if (channels.size() == 0 || channels.find(c) != channels.end()) {
+        copy.channels.push_back(c);
+      }
+    }
+    if (copy.channels.size() == 0) {
+      continue;
+    }
+
+    int plane = copy.height * copy.width;
+    int nr_planes = copy.num * copy.channels.size();
+    copy.data.resize(nr_planes * plane);
+    if (store_diff) {
+      copy.diff.resize(nr_planes * plane);
+    }
+
+    const float* cpu_ptr = blob->cpu_data();
+    const float* cpu_diff_ptr = store_diff ? blob->cpu_diff() : nullptr;
+
+    // Only the selected planes are copied, in (n, c) order
+    for (int n = 0; n < copy.num; ++n) {
+      for (unsigned int k = 0; k < copy.channels.size(); ++k) {
+        int src = (n * blob->channels() + copy.channels[k]) * plane;
+        int dst = (n * copy.channels.size() + k) * plane;
+        std::copy(cpu_ptr + src, cpu_ptr + src + plane, &copy.data[dst]);
+        if (store_diff) {
+          std::copy(cpu_diff_ptr + src, cpu_diff_ptr + src + plane,
+                    &copy.diff[dst]);
+        }
+      }
+    }
+    copies.push_back(copy);
+  }
+  return copies;
+}
+
+// Normalize to [0, 255] and write as 8 bit PNG
+static void WriteNormalizedPng(const float* data, int height, int width,
+                               std::string file) {
+  cv::Mat mat(height, width, CV_32FC1, const_cast<float*>(data));
+  double minVal, maxVal;
+  cv::minMaxLoc(mat, &minVal, &maxVal);
+  double range = maxVal - minVal;
+  if (range == 0) {
+    range = 1.0;
+  }
+  cv::Mat outuc;
+  mat.convertTo(outuc, CV_8UC1, 255.0 / range, -minVal * 255.0 / range);
+  cv::imwrite(file, outuc);
+}
+
+static void WriteRaw(const BlobCopy &copy, const std::vector<float> &data,
+                     std::string file) {
+  std::ofstream out(file, std::ios::out | std::ios::binary);
+  if (!out) {
+    LOG(ERROR) << "Could not write filter output: " << file;
+    return;
+  }
+  int32_t header[4] = { copy.num, static_cast<int32_t>(copy.channels.size()),
+      copy.height, copy.width };
+  out.write(reinterpret_cast<const char*>(header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(&data[0]),
+            data.size() * sizeof(float));
+}
+
+static void WriteTiff(const BlobCopy &copy, const std::vector<float> &data,
+                      std::string file) {
+  int plane = copy.height * copy.width;
+  std::vector<cv::Mat> pages;
+  for (unsigned int p = 0; p < copy.num * copy.channels.size(); ++p) {
+    pages.push_back(cv::Mat(copy.height, copy.width, CV_32FC1,
+                            const_cast<float*>(&data[p * plane])));
+  }
+  SaveTiff(pages, file);
+}
+
+void WriteBlobs(const std::vector<BlobCopy> &copies, std::string output_folder,
+                bofs::path input_name, int st, int y, int x,
+                std::string format) {
+  std::stringstream ssp;
+  ssp << input_name.stem().string();
+  ssp << "_" << st << "_" << y << "_" << x;
+
+  bofs::path outpl(output_folder);
+  outpl /= (ssp.str());
+  bofs::create_directories(outpl);
+
+  for (unsigned int i = 0; i < copies.size(); ++i) {
+    const BlobCopy &copy = copies[i];
+    bool store_diff = copy.diff.size() > 0;
+
+    if (format == "raw" || format == "tif") {
+      bofs::path filep = outpl;
+      filep /= (copy.name + "." + format);
+      bofs::path filepd = outpl;
+      filepd /= (copy.name + "_diff." + format);
+      if (format == "raw") {
+        WriteRaw(copy, copy.data, filep.string());
+        if (store_diff) {
+          WriteRaw(copy, copy.diff, filepd.string());
+        }
+      } else {
+        WriteTiff(copy, copy.data, filep.string());
+        if (store_diff) {
+          WriteTiff(copy, copy.diff, filepd.string());
+        }
+      }
+      continue;
+    }
+
+    int plane = copy.height * copy.width;
+    for (int n = 0; n < copy.num; ++n) {
+      for (unsigned int k = 0; k < copy.channels.size(); ++k) {
+        int offset = (n * copy.channels.size() + k) * plane;
+
+        std::stringstream ssf;
+        ssf << copy.name << "_" << n << "_" << copy.channels[k];
+
+        bofs::path filep = outpl;
+        filep /= (ssf.str() + ".png");
+        WriteNormalizedPng(&copy.data[offset], copy.height, copy.width,
+                           filep.string());
+
+        if (store_diff) {
+          bofs::path filepd = outpl;
+          filepd /= (ssf.str() + "_diff.png");
+          WriteNormalizedPng(&copy.diff[offset], copy.height, copy.width,
+                             filepd.string());
+        }
+      }
+    }
+  }
+}
+
+FilterExporter::FilterExporter(const FilterOutputParam &param)
+    : enabled_(false),
+      interval_(param.interval()),
+      calls_(0),
+      skipped_(0) {
+  enabled_ = param.has_output_filters() && param.output_filters()
+      && param.has_output();
+  output_ = param.output();
+  format_ = param.format();
+  if (format_ != "png" && format_ != "raw" && format_ != "tif") {
+    LOG(FATAL) << "Unknown filter output format: " << format_;
+  }
+  if (interval_ < 1) {
+    interval_ = 1;
+  }
+  for (int i = 0; i < param.blob_size(); ++i) {
+    blobs_.insert(param.blob(i));
+  }
+  for (int i = 0; i < param.channel_size(); ++i) {
+    channels_.insert(param.channel(i));
+  }
+}
+
+FilterExporter::~FilterExporter() {
+  Wait();
+  if (skipped_ > 0) {
+    LOG(INFO) << "Filter exports skipped (writer busy): " << skipped_;
+  }
+}
+
+bool FilterExporter::enabled() {
+  return enabled_;
+}
+
+void FilterExporter::Export(Net<float> *net, bofs::path input_name, int st,
+                            int y, int x, bool store_diff) {
+  if (!enabled_ || (calls_++ % interval_) != 0) {
+    return;
+  }
+
+  // Never stall the caller on the disk, drop this export instead
+  if (pending_.valid()
+      && pending_.wait_for(std::chrono::seconds(0))
+          != std::future_status::ready) {
+    ++skipped_;
+    return;
+  }
+  Wait();
+
+  std::shared_ptr<std::vector<BlobCopy>> copies =
+      std::make_shared<std::vector<BlobCopy>>(
+          CopyBlobs(net, blobs_, channels_, store_diff));
+
+  std::string output = output_;
+  std::string format = format_;
+  pending_ = std::async(std::launch::async, [copies, output, input_name, st, y,
+                        x, format]() {
+    WriteBlobs(*copies, output, input_name, st, y, x, format);
+  });
+}
+
+void FilterExporter::Wait() {
+  if (pending_.valid()) {
+    pending_.get();
+  }
+}
+
+}  // namespace caffe_neural
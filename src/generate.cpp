@@ -0,0 +1,185 @@
+/*
+ * generate.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "generate.hpp"
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cmath>
+#include "benchmark.hpp"
+#include "filesystem_utils.hpp"
+#include "philox_random.hpp"
+#include "tiffio_wrapper.hpp"
+#include "utils.hpp"
+
+namespace caffe_neural {
+
+// Random label blocks, drawn with the cumulative label balance
+static cv::Mat GenerateLabel(int width, int height, int block_size,
+                             std::vector<float> &cumulative,
+                             PhiloxRandom &rng) {
+  cv::Mat label(height, width, CV_8UC1);
+  for (int y = 0; y < height; y += block_size) {
+    for (int x = 0; x < width; x += block_size) {
+      float draw = rng.Uniform(0.0f, cumulative[cumulative.size() - 1]);
+      int l = std::upper_bound(cumulative.begin(), cumulative.end(), draw)
+          - cumulative.begin();
+      l = std::min(l, (int) cumulative.size() - 1);
+      cv::Rect block(x, y, std::min(block_size, width - x),
+                     std::min(block_size, height - y));
+      label(block).setTo(cv::Scalar(l));
+    }
+  }
+  return label;
+}
+
+// Uniform noise around the intensity of each label, random streams
+// stream to stream + channels - 1
+static cv::Mat GenerateRaw(cv::Mat &label, int nr_labels, int channels,
+                           uint64_t seed, uint64_t stream) {
+  cv::Mat lut(1, 256, CV_8UC1, cv::Scalar(0));
+  for (int l = 0; l < nr_labels; ++l) {
+    lut.at<unsigned char>(0, l) = (unsigned char) ((l + 0.5) * 256.0
+        / nr_labels);
+  }
+  cv::Mat mean;
+  cv::LUT(label, lut, mean);
+  mean.convertTo(mean, CV_32FC1);
+
+  std::vector<cv::Mat> planes(channels);
+  for (int c = 0; c < channels; ++c) {
+    cv::Mat noise(label.rows, label.cols, CV_32FC1);
+    FillUniform(noise, seed, stream + c, -48.0, 48.0);
+    planes[c] = mean + noise;
+  }
+  cv::Mat merged;
+  cv::merge(planes, merged);
+
+  cv::Mat raw;
+  merged.convertTo(raw, CV_8UC(channels));
+  return raw;
+}
+
+static void WriteStack(std::vector<cv::Mat> &stack, std::string format,
+                       bofs::path file) {
+  if (format == "tif") {
+    SaveTiff(stack, file.string());
+  } else {
+    cv::imwrite(file.string(), stack[0]);
+  }
+}
+
+int Generate(ToolParam &tool_param, CommonSettings &settings) {
+
+  if (tool_param.generate_size() <= settings.param_index) {
+    LOG(FATAL)<< "Generate parameter index does not exist.";
+  }
+
+  GenerateParam generate_param = tool_param.generate(settings.param_index);
+
+  if(!(generate_param.has_raw_images() && generate_param.has_label_images())) {
+    LOG(FATAL) << "Raw images or label images folder missing.";
+  }
+
+  int images = generate_param.images();
+  int width = generate_param.width();
+  int height = generate_param.height();
+  int channels = generate_param.channels();
+  int nr_labels = generate_param.labels();
+  int pages = generate_param.pages();
+  int block_size = generate_param.block_size();
+  bool subfolders = generate_param.label_subfolders();
+
+  std::string format = generate_param.format();
+  std::transform(format.begin(), format.end(), format.begin(), ::tolower);
+  if (format == "tiff") {
+    format = "tif";
+  }
+  if (format != "png" && format != "tif") {
+    LOG(FATAL) << "Unsupported generator format: " << format;
+  }
+  if (pages > 1 && format != "tif") {
+    LOG(FATAL) << "Multi-page images need the tif format.";
+  }
+  if (nr_labels < 1 || nr_labels > 256) {
+    LOG(FATAL) << "Label count must be between 1 and 256.";
+  }
+  if (channels != 1 && channels != 3) {
+    LOG(FATAL) << "Channel count must be 1 or 3.";
+  }
+
+  std::vector<float> cumulative(nr_labels, 1.0);
+  if (generate_param.label_balance_size() > 0) {
+    if (generate_param.label_balance_size() != nr_labels) {
+      LOG(FATAL) << "Label balance needs one frequency per label.";
+    }
+    for (int l = 0; l < nr_labels; ++l) {
+      cumulative[l] = generate_param.label_balance(l);
+    }
+  }
+  for (int l = 1; l < nr_labels; ++l) {
+    cumulative[l] += cumulative[l - 1];
+  }
+
+  uint64_t seed = generate_param.has_seed() ?
+      generate_param.seed() : GetTimeSeed();
+
+  bofs::path rawpath(generate_param.raw_images());
+  bofs::path labelpath(generate_param.label_images());
+  bofs::create_directories(rawpath);
+  bofs::create_directories(labelpath);
+
+  std::vector<bofs::path> labelpaths;
+  if (subfolders) {
+    for (int l = 0; l < nr_labels; ++l) {
+      bofs::path subpath = labelpath;
+      subpath /= ZeroPadNumber(l, std::log10(nr_labels) + 1);
+      bofs::create_directories(subpath);
+      labelpaths.push_back(subpath);
+    }
+  }
+
+  LOG(INFO) << "Generating " << images << " images (" << width << "x"
+            << height << "x" << pages << ", " << channels << " channels, "
+            << nr_labels << " labels)";
+
+#pragma omp parallel for schedule(dynamic)
+  for (int i = 0; i < images; ++i) {
+    // Own random streams per image, independent of the thread count: the
+    // labels use stream i, the raw slices follow after all images
+    PhiloxRandom rng(seed, i);
+
+    std::vector<cv::Mat> raw_stack(pages);
+    std::vector<cv::Mat> label_stack(pages);
+    for (int p = 0; p < pages; ++p) {
+      label_stack[p] = GenerateLabel(width, height, block_size, cumulative,
+                                     rng);
+      raw_stack[p] = GenerateRaw(
+          label_stack[p], nr_labels, channels, seed,
+          images + ((uint64_t) i * pages + p) * channels);
+    }
+
+    std::string file = "synthetic_" + ZeroPadNumber(i, 4) + "." + format;
+    WriteStack(raw_stack, format, rawpath / file);
+
+    if (subfolders) {
+      for (int l = 0; l < nr_labels; ++l) {
+        std::vector<cv::Mat> mask_stack(pages);
+        for (int p = 0; p < pages; ++p) {
+          cv::compare(label_stack[p], cv::Scalar(l), mask_stack[p],
+                      cv::CMP_EQ);
+        }
+        WriteStack(mask_stack, format, labelpaths[l] / file);
+      }
+    } else {
+      WriteStack(label_stack, format, labelpath / file);
+    }
+  }
+
+  return 0;
+}
+
+}  // namespace caffe_neural
@@ -0,0 +1,151 @@
+/*
+ * hard_example_sampler.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "hard_example_sampler.hpp"
+#include <algorithm>
+
+// Lower bound of a cell weight, keeps every cell reachable
+#define HEM_MIN_WEIGHT 1e-6
+
+namespace caffe_neural {
+
+FenwickTree::FenwickTree()
+    : total_(0),
+      top_step_(0),
+      updates_(0) {
+}
+
+void FenwickTree::Resize(long n, double weight) {
+  weights_.assign(n, weight);
+  top_step_ = 1;
+  while (top_step_ * 2 <= n) {
+    top_step_ *= 2;
+  }
+  Rebuild();
+}
+
+void FenwickTree::Rebuild() {
+  long n = weights_.size();
+  tree_.assign(n + 1, 0.0);
+  total_ = 0;
+  for (long j = 1; j <= n; ++j) {
+    tree_[j] += weights_[j - 1];
+    total_ += weights_[j - 1];
+    long parent = j + (j & -j);
+    if (parent <= n) {
+      tree_[parent] += tree_[j];
+    }
+  }
+  updates_ = 0;
+}
+
+void FenwickTree::Set(long i, double weight) {
+  long n = weights_.size();
+  double delta = weight - weights_[i];
+  weights_[i] = weight;
+  total_ += delta;
+  for (long j = i + 1; j <= n; j += j & -j) {
+    tree_[j] += delta;
+  }
+  // Bound the floating point drift of the incremental updates
+  if (++updates_ > n) {
+    Rebuild();
+  }
+}
+
+double FenwickTree::weight(long i) {
+  return weights_[i];
+}
+
+long FenwickTree::size() {
+  return weights_.size();
+}
+
+double FenwickTree::total() {
+  return total_;
+}
+
+long FenwickTree::Find(double value) {
+  long n = weights_.size();
+  long pos = 0;
+  for (long step = top_step_; step > 0; step >>= 1) {
+    if (pos + step <= n && tree_[pos + step] <= value) {
+      pos += step;
+      value -= tree_[pos];
+    }
+  }
+  return std::min(pos, n - 1);
+}
+
+HardExampleSampler::HardExampleSampler()
+    : off_size_x_(0),
+      off_size_y_(0),
+      cell_size_(1),
+      cells_x_(0),
+      cells_y_(0),
+      momentum_(0.9),
+      initialized_(false) {
+}
+
+void HardExampleSampler::Init(int images, int off_size_x, int off_size_y,
+                              int cell_size, float momentum) {
+  off_size_x_ = off_size_x;
+  off_size_y_ = off_size_y;
+  cell_size_ = std::max(cell_size, 1);
+  cells_x_ = (off_size_x - 1) / cell_size_ + 1;
+  cells_y_ = (off_size_y - 1) / cell_size_ + 1;
+  momentum_ = momentum;
+  initialized_ = false;
+  cell_loss_.Resize((long) images * cells_y_ * cells_x_, 1.0);
+}
+
+long HardExampleSampler::Cell(long abs_id) {
+  long img = abs_id / ((long) off_size_x_ * off_size_y_);
+  long rest = abs_id - img * off_size_x_ * off_size_y_;
+  int y = rest / off_size_x_;
+  int x = rest - (long) y * off_size_x_;
+  return (img * cells_y_ + y / cell_size_) * cells_x_ + x / cell_size_;
+}
+
+long HardExampleSampler::Sample(PhiloxRandom &rng) {
+  long cell = cell_loss_.Find(rng.Uniform(0.0, cell_loss_.total()));
+
+  long img = cell / (cells_x_ * cells_y_);
+  int cy = (cell / cells_x_) % cells_y_;
+  int cx = cell % cells_x_;
+
+  // Uniform offset inside the (possibly clipped) cell
+  int y = rng.UniformInt(cy * cell_size_,
+                         std::min((cy + 1) * cell_size_, off_size_y_) - 1);
+  int x = rng.UniformInt(cx * cell_size_,
+                         std::min((cx + 1) * cell_size_, off_size_x_) - 1);
+
+  return (img * off_size_y_ + y) * off_size_x_ + x;
+}
+
+void HardExampleSampler::Update(const std::vector<long> &abs_ids,
+                                const std::vector<double> &losses) {
+  if (abs_ids.size() == 0) {
+    return;
+  }
+  if (!initialized_) {
+    // Cells that were never drawn start at the first observed mean loss
+    double mean = 0.0;
+    for (unsigned int i = 0; i < losses.size(); ++i) {
+      mean += std::max(losses[i], 0.0) / losses.size();
+    }
+    cell_loss_.Resize(cell_loss_.size(), std::max(mean, HEM_MIN_WEIGHT));
+    initialized_ = true;
+  }
+  for (unsigned int i = 0; i < abs_ids.size(); ++i) {
+    long cell = Cell(abs_ids[i]);
+    double loss = std::max(losses[i], 0.0);
+    cell_loss_.Set(cell, std::max(momentum_ * cell_loss_.weight(cell)
+                       + (1.0 - momentum_) * loss, HEM_MIN_WEIGHT));
+  }
+}
+
+}  // namespace caffe_neural
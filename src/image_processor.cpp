@@ -7,19 +7,47 @@
 
 #include "image_processor.hpp"
 #include "process.hpp"
+#include "memory_data_buffer.hpp"
+#include "pipeline_stats.hpp"
+#include "trace.hpp"
+#include "memory_profiler.hpp"
 #include <glog/logging.h>
 
 #include <omp.h>
+#include <algorithm>
 #include <iostream>
 #include <set>
 #include "utils.hpp"
 
+// First Philox block of the per pixel masking numbers, far away from the
+// blocks used by the sequential draws of the same patch stream
+#define MASK_RANDOM_BLOCK (((uint64_t) 1) << 32)
+
 namespace caffe_neural {
 
 ImageProcessor::ImageProcessor(int patch_size, int nr_labels)
     : patch_size_(patch_size),
-      nr_labels_(nr_labels) {
+      nr_labels_(nr_labels),
+      offset_range_(0),
+      seed_(GetTimeSeed()),
+      sequence_index_(0) {
+
+}
+
+void ImageProcessor::SetSeed(uint64_t seed) {
+  seed_ = seed;
+  sequence_index_ = 0;
+}
 
+void ImageProcessor::SetPipelineStats(PipelineStats *stats) {
+  stats_ = stats;
+  if (stats_ != nullptr) {
+    stage_mirror_ = stats_->AddStage("mirror");
+    stage_warp_ = stats_->AddStage("warp");
+    stage_blur_ = stats_->AddStage("blur");
+    stage_write_ = stats_->AddStage("write");
+    stage_label_ = stats_->AddStage("label");
+  }
 }
 
 std::vector<cv::Mat>& ImageProcessor::raw_images() {
@@ -34,6 +62,14 @@ std::vector<int>& ImageProcessor::image_number() {
   return image_number_;
 }
 
+std::vector<long>& ImageProcessor::label_counter() {
+  return label_counter_;
+}
+
+std::vector<float>& ImageProcessor::label_value() {
+  return label_value_;
+}
+
 void ImageProcessor::SetCropParams(int image_crop, int label_crop) {
   image_crop_ = image_crop;
   label_crop_ = label_crop;
@@ -56,6 +92,7 @@ void ImageProcessor::SetLabelConsolidateParams(bool apply, std::vector<int> labe
 
 void ImageProcessor::SubmitImage(cv::Mat raw, int img_id,
                                  std::vector<cv::Mat> labels) {
+  TraceScope trace("SubmitImage");
 
   std::vector<cv::Mat> rawsplit;
   cv::split(raw, rawsplit);
@@ -92,6 +129,8 @@ void ImageProcessor::SubmitImage(cv::Mat raw, int img_id,
 }
 
 int ImageProcessor::Init() {
+  TraceScope trace("Init");
+  MemoryPhase phase("init");
 
   if (label_stack_[0].size() > 1) {
     for (unsigned int j = 0; j < label_stack_.size(); ++j) {
@@ -149,6 +188,13 @@ int ImageProcessor::Init() {
 
   label_stack_.clear();
 
+  // Label value table for DrawPatchRandom (consolidation)
+  label_value_.resize(nr_labels_);
+  for (int l = 0; l < nr_labels_; ++l) {
+    label_value_[l] = label_consolidate_ ? label_consolidate_labels_[l] : l;
+  }
+  label_counter_.assign(nr_labels_ + 1, 0);
+
   if (raw_images_.size() == 0 || label_images_.size() == 0
       || raw_images_.size() != label_images_.size()) {
     return -1;
@@ -160,8 +206,27 @@ int ImageProcessor::Init() {
   int off_size_x = (image_size_x_ - patch_size_) + 1;
   int off_size_y = (image_size_y_ - patch_size_) + 1;
 
-  offset_selector_ = GetRandomUniform<double>(
-      0, label_images_.size() * off_size_x * off_size_y);
+  offset_range_ = (double) label_images_.size() * off_size_x * off_size_y;
+
+  if (image_weight_.size() > 0 && image_weight_.size() != label_images_.size()) {
+    LOG(FATAL) << "Image weights (" << image_weight_.size()
+               << ") do not match the images (" << label_images_.size() << ")";
+  }
+
+  image_running_weight_.clear();
+  if (image_weight_.size() > 0) {
+    double running_weight = 0;
+    for (unsigned int k = 0; k < image_weight_.size(); ++k) {
+      running_weight += (double) image_weight_[k] * off_size_x * off_size_y;
+      image_running_weight_.push_back(running_weight);
+    }
+    offset_range_ = running_weight;
+  }
+
+  if (apply_hard_mining_) {
+    hard_sampler_.Init(label_images_.size(), off_size_x, off_size_y,
+                       hard_mining_cell_size_, hard_mining_momentum_);
+  }
 
   if (apply_label_hist_eq_) {
 
@@ -228,6 +293,9 @@ int ImageProcessor::Init() {
               patch_weight += (((double) (patch_label_count[l]))
                   / ((double) (patch_size_ * patch_size_))) / (label_freq[l]);
             }
+            if (image_weight_.size() > 0) {
+              patch_weight *= image_weight_[k];
+            }
             for (int l = 0; l < nr_labels_; ++l) {
               weighted_label_count[l] += patch_weight * patch_label_count[l];
             }
@@ -250,8 +318,8 @@ int ImageProcessor::Init() {
         LOG(INFO) << "Label " << l << ": " << label_freq[l];
       }
 
-      offset_selector_ = GetRandomUniform<double>(
-          0, label_running_probability_[label_running_probability_.size() - 1]);
+      offset_range_ = label_running_probability_[label_running_probability_
+          .size() - 1];
     }
 
     if (apply_label_pixel_mask_) {
@@ -290,7 +358,6 @@ void ImageProcessor::SetBlurParams(bool apply, float mean, float std,
   blur_mean_ = mean;
   blur_std_ = std;
   blur_size_ = blur_size;
-  blur_random_selector_ = GetRandomNormal<float>(mean, std);
 }
 
 void ImageProcessor::SetBorderParams(bool apply, int border_size) {
@@ -306,11 +373,9 @@ void ImageProcessor::SetClaheParams(bool apply, float clip_limit) {
 
 void ImageProcessor::SetRotationParams(bool apply) {
   apply_rotation_ = apply;
-  rotation_rand_ = GetRandomOffset(0, 359);
 }
 void ImageProcessor::SetPatchMirrorParams(bool apply) {
   apply_patch_mirroring_ = apply;
-  patch_mirror_rand_ = GetRandomOffset(0, 2);
 }
 
 void ImageProcessor::SetLabelHistEqParams(bool apply, bool patch_prior,
@@ -319,23 +384,34 @@ void ImageProcessor::SetLabelHistEqParams(bool apply, bool patch_prior,
   apply_label_hist_eq_ = apply;
   apply_label_patch_prior_ = patch_prior;
   apply_label_pixel_mask_ = mask_prob;
-  label_mask_prob_rand_.resize(omp_get_max_threads());
-  for (int i = 0; i < omp_get_max_threads(); ++i) {
-    label_mask_prob_rand_[i] = GetRandomUniform<float>(0.0, 1.0);
-  }
   label_boost_ = label_boost;
 }
 
 void ImageProcessor::SetScaleParams(bool apply) {
   apply_scaling_ = apply;
-  //Note that later it is mapped to 0,5 steps, manuelly.
-  //Do not forget to update this pice of code as well!!!
-  scale_rand_ = GetRandomUniform<float>(0.5, 2.5);
 }
 
 void ImageProcessor::SetTranslateParams(bool apply) {
   apply_translate_ = apply;
-  trans_rand_ = GetRandomUniform(-10, 10);
+}
+
+void ImageProcessor::SetHardMiningParams(bool apply, int cell_size,
+                                         float mix, float momentum) {
+  apply_hard_mining_ = apply;
+  hard_mining_cell_size_ = cell_size;
+  hard_mining_mix_ = mix;
+  hard_mining_momentum_ = momentum;
+}
+
+void ImageProcessor::UpdateLoss(const std::vector<long> &patch_ids,
+                                const std::vector<double> &losses) {
+  if (apply_hard_mining_) {
+    hard_sampler_.Update(patch_ids, losses);
+  }
+}
+
+bool ImageProcessor::hard_mining() {
+  return apply_hard_mining_;
 }
 
 void ImageProcessor::SetUpParams(InputParam &input_param, std::map<std::string, int> &params) {
@@ -360,6 +436,17 @@ void ImageProcessor::SetUpParams(InputParam &input_param, std::map<std::string,
   this->SetScaleParams(preprocessor_param.has_scale() && preprocessor_param.scale());
   this->SetTranslateParams(preprocessor_param.has_translate() && preprocessor_param.translate());
 
+  if(preprocessor_param.has_hard_mining()) {
+    PrepHardMiningParam hard_mining_param = preprocessor_param.hard_mining();
+    this->SetHardMiningParams(true, hard_mining_param.cell_size(),
+                              hard_mining_param.mix(),
+                              hard_mining_param.momentum());
+  }
+
+  if(preprocessor_param.has_seed()) {
+    this->SetSeed(preprocessor_param.seed());
+  }
+
   if(preprocessor_param.has_label_consolidate()) {
     LabelConsolidateParam label_consolidate_param = preprocessor_param.label_consolidate();
     std::vector<int> con_labels;
@@ -394,7 +481,7 @@ void ImageProcessor::SetUpParams(InputParam &input_param, std::map<std::string,
   }
 }
 
-cv::Mat ImageProcessor::scale(float scale) {
+cv::Matx33d ImageProcessor::scale(float scale) {
   if ((scale >= 0.5) && (scale < 1.0))
     scale = 0.5;
   else if ((scale >= 1.5) && (scale <2.0))
@@ -404,20 +491,23 @@ cv::Mat ImageProcessor::scale(float scale) {
   else
     scale = 1.0;
 
-  return (cv::Mat_<double>(3,3) << scale, 0, 0, 0, scale, 0, 0, 0, 1);
+  return cv::Matx33d(scale, 0, 0, 0, scale, 0, 0, 0, 1);
 }
 
-cv::Mat ImageProcessor::translate(double translate) {
-  return (cv::Mat_<double>(3,3) << 1, 0, translate, 0, 1, translate, 0, 0, 1);
+cv::Matx33d ImageProcessor::translate(double translate) {
+  return cv::Matx33d(1, 0, translate, 0, 1, translate, 0, 0, 1);
 }
 
-cv::Mat ImageProcessor::rotate(cv::Mat& src, double angle) {
-  cv::Point pt = cv::Point(src.cols / 2, src.rows / 2);
-  cv::Mat r_33 = cv::Mat::eye(cv::Size(3,3), CV_64FC1);
-  cv::Mat r = cv::getRotationMatrix2D(pt, angle, 1.0);
-  r.copyTo(r_33(cv::Rect(0, 0, r.cols, r.rows)));
-  
-  return r_33;
+cv::Matx33d ImageProcessor::rotate(cv::Mat& src, double angle) {
+  // Same as cv::getRotationMatrix2D around the patch center, without a Mat
+  double cx = src.cols / 2;
+  double cy = src.rows / 2;
+  double alpha = std::cos(angle * CV_PI / 180.0);
+  double beta = std::sin(angle * CV_PI / 180.0);
+
+  return cv::Matx33d(alpha, beta, (1 - alpha) * cx - beta * cy,
+                     -beta, alpha, beta * cx + (1 - alpha) * cy,
+                     0, 0, 1);
 }
 
 long ImageProcessor::BinarySearchPatch(double offset) {
@@ -436,26 +526,65 @@ long ImageProcessor::BinarySearchPatch(double offset) {
   return left;
 }
 
+double ImageProcessor::offset_range() {
+  return offset_range_;
+}
+
+void ImageProcessor::SetImageWeights(std::vector<float> weights) {
+  image_weight_ = weights;
+}
+
+long ImageProcessor::WeightedPatch(double offset) {
+  long patches = (long) ((image_size_x_ - patch_size_) + 1)
+      * ((image_size_y_ - patch_size_) + 1);
+  long img_id = std::upper_bound(image_running_weight_.begin(),
+                                 image_running_weight_.end(), offset)
+      - image_running_weight_.begin();
+  img_id = std::min(img_id, (long) image_running_weight_.size() - 1);
+  double start = img_id > 0 ? image_running_weight_[img_id - 1] : 0.0;
+  long patch = (long) ((offset - start) / image_weight_[img_id]);
+  return img_id * patches + std::min(std::max(patch, 0L), patches - 1);
+}
+
 ProcessImageProcessor::ProcessImageProcessor(int patch_size, int nr_labels)
     : ImageProcessor(patch_size, nr_labels) {
 }
 
 TrainImageProcessor::TrainImageProcessor(int patch_size, int nr_labels)
-    : ImageProcessor(patch_size, nr_labels) {
+    : ImageProcessor(patch_size, nr_labels),
+      patch_pool_(kPoolSlots) {
+}
+
+MatPool& TrainImageProcessor::patch_pool() {
+  return patch_pool_;
 }
 
-std::vector<cv::Mat> TrainImageProcessor::DrawPatchRandom() {
+long TrainImageProcessor::DrawPatchRandom(float* patch_data, float* label_data,
+                                          std::vector<cv::Mat> &patch_label) {
+  TraceScope trace("DrawPatchRandom");
 
-  double offset = offset_selector_();
+  // Every random decision for this patch comes from its own stream
+  PhiloxRandom rng(seed_, sequence_index_.fetch_add(1));
+
+  double offset = rng.Uniform(0.0, offset_range_);
 
   long abs_id = 0;
 
   if (apply_label_hist_eq_ && apply_label_patch_prior_) {
     abs_id = BinarySearchPatch(offset);
+  } else if (image_running_weight_.size() > 0) {
+    abs_id = WeightedPatch(offset);
   } else {
     abs_id = (long) offset;
   }
 
+  if (apply_hard_mining_) {
+    // Mix loss weighted hard regions with the prior above
+    if (rng.Uniform(0.0f, 1.0f) < hard_mining_mix_) {
+      abs_id = hard_sampler_.Sample(rng);
+    }
+  }
+
   int off_size_x = (image_size_x_ - patch_size_) + 1;
   int off_size_y = (image_size_y_ - patch_size_) + 1;
 
@@ -473,46 +602,62 @@ std::vector<cv::Mat> TrainImageProcessor::DrawPatchRandom() {
   cv::Rect roi_patch(xoff, yoff, actual_patch_size, actual_patch_size);
   cv::Rect roi_label(xoff, yoff, actual_label_size, actual_label_size);
 
-// Deep copy so that the original image in storage doesn't get messed up
-  cv::Mat patch = full_image(roi_patch).clone();
-  cv::Mat label = full_label(roi_label).clone();
+  // Views into storage, augmentations below must never operate in place
+  cv::Mat patch = full_image(roi_patch);
+  cv::Mat label = full_label(roi_label);
 
+  // Intermediate results live in pooled per thread scratch Mats
   if (apply_patch_mirroring_) {
-    int flipcode = patch_mirror_rand_() - 1;
-    cv::Mat mirror_patch;
-    cv::Mat mirror_label;
+    StageTimer timer(stats_, stage_mirror_);
+    int flipcode = rng.UniformInt(0, 2) - 1;
+    cv::Mat &mirror_patch = patch_pool_.Get(kMirrorPatch, patch.rows,
+                                            patch.cols, patch.type());
+    cv::Mat &mirror_label = patch_pool_.Get(kMirrorLabel, label.rows,
+                                            label.cols, label.type());
     cv::flip(patch, mirror_patch, flipcode);
     cv::flip(label, mirror_label, flipcode);
     patch = mirror_patch;
     label = mirror_label;
   }
 
-  std::vector<cv::Mat> trans_matrix;
+  // Fixed size matrices, no heap allocations
+  cv::Matx33d trans_matrix[3];
+  int trans_count = 0;
   
   if (apply_scaling_) {
-    float  rand_scale = scale_rand_();
-    trans_matrix.push_back(scale(rand_scale).clone());
+    //Note that later it is mapped to 0,5 steps, manuelly.
+    //Do not forget to update this pice of code as well!!!
+    float  rand_scale = rng.Uniform(0.5f, 2.5f);
+    trans_matrix[trans_count++] = scale(rand_scale);
   }
 
   if (apply_rotation_) {
-    int rand_angle = rotation_rand_();
-    trans_matrix.push_back(rotate(patch, rand_angle*1.0));
+    int rand_angle = rng.UniformInt(0, 359);
+    trans_matrix[trans_count++] = rotate(patch, rand_angle*1.0);
   }
 
   if (apply_translate_) {
-    int trans = trans_rand_();
-    trans_matrix.push_back(translate(trans));
+    int trans = rng.UniformInt(-10, 10);
+    trans_matrix[trans_count++] = translate(trans);
   }
   
   if (apply_scaling_ || apply_translate_ || apply_rotation_) {
-    std::random_shuffle(trans_matrix.begin(), trans_matrix.end());
+    StageTimer timer(stats_, stage_warp_);
+    rng.Shuffle(trans_matrix, trans_count);
 
-    cv::Mat final_trans_mat = trans_matrix[0];
-    for(int i = 1; i < trans_matrix.size(); ++i)
+    cv::Matx33d final_trans_mat = trans_matrix[0];
+    for(int i = 1; i < trans_count; ++i)
       final_trans_mat = final_trans_mat * trans_matrix[i];
+    cv::Matx23d affine_mat = final_trans_mat.get_minor<2, 3>(0, 0);
 
-    cv::warpAffine(patch, patch, final_trans_mat(cv::Rect(0, 0, 3, 2)), patch.size(), cv::INTER_LINEAR, cv::BORDER_REFLECT_101);
-    cv::warpAffine(label, label, final_trans_mat(cv::Rect(0, 0, 3, 2)), label.size(), cv::INTER_NEAREST, cv::BORDER_REFLECT_101);
+    cv::Mat &warp_patch = patch_pool_.Get(kWarpPatch, patch.rows, patch.cols,
+                                          patch.type());
+    cv::Mat &warp_label = patch_pool_.Get(kWarpLabel, label.rows, label.cols,
+                                          label.type());
+    cv::warpAffine(patch, warp_patch, affine_mat, patch.size(), cv::INTER_LINEAR, cv::BORDER_REFLECT_101);
+    cv::warpAffine(label, warp_label, affine_mat, label.size(), cv::INTER_NEAREST, cv::BORDER_REFLECT_101);
+    patch = warp_patch;
+    label = warp_label;
 
   }
 
@@ -526,44 +671,73 @@ std::vector<cv::Mat> TrainImageProcessor::DrawPatchRandom() {
   label = label(roi_rot_label);
 
   if (apply_blur_) {
+    StageTimer timer(stats_, stage_blur_);
     cv::Size ksize(blur_size_, blur_size_);
-    float sigma = blur_random_selector_();
-    cv::GaussianBlur(patch, patch, ksize, sigma);
+    float sigma = rng.Normal(blur_mean_, blur_std_);
+    cv::Mat &blur_patch = patch_pool_.Get(kBlurPatch, patch.rows, patch.cols,
+                                          patch.type());
+    cv::GaussianBlur(patch, blur_patch, ksize, sigma);
+    patch = blur_patch;
   }
 
-  if (apply_label_hist_eq_ && apply_label_pixel_mask_) {
-#pragma omp parallel
-    {
-      std::function<float()> &randprob =
-          label_mask_prob_rand_[omp_get_thread_num()];
-#pragma omp for
-      for (int y = 0; y < patch_size_; ++y) {
-        for (int x = 0; x < patch_size_; ++x) {
-          label.at<float>(y, x) =
-              label_mask_probability_[label.at<float>(y, x)] >= randprob() ?
-                  label.at<float>(y, x) : -1.0;
-        }
-      }
-    }
+  // The only copy of the sample, directly into the network input storage
+  {
+    StageTimer timer(stats_, stage_write_);
+    WritePlanar(patch, patch_data);
+    cv::Mat label_out(label.rows, label.cols, CV_32FC1, label_data);
+    label.copyTo(label_out);
+    label = label_out;
   }
 
-  std::vector<cv::Mat> patch_label;
+  StageTimer label_timer(stats_, stage_label_);
 
-  if (label_consolidate_) {
-#pragma omp parallel for
-    for (int y = 0; y < label.rows; ++y) {
-      for (int x = 0; x < label.cols; ++x) {
-        label.at<float>(y, x) = label.at<float>(y, x) < 0 ?
-            -1.0 : label_consolidate_labels_[label.at<float>(y, x)];
-      }
+  // Masking, consolidation and label counting fused in one pass over the
+  // (continuous) label storage, using the tables prepared by Init()
+  float* label_ptr = label_data;
+  long label_count = label.rows * label.cols;
+  const float* label_value = &label_value_[0];
+  // Counted per thread, merged atomically (concurrent draws)
+  thread_local std::vector<long> local_counter;
+  local_counter.assign(label_counter_.size(), 0);
+  long* counter = &local_counter[1];
+
+  if (apply_label_hist_eq_ && apply_label_pixel_mask_) {
+    // Bulk generated, one number per pixel
+    cv::Mat &randprob = patch_pool_.Get(kMaskRandom, label.rows, label.cols,
+                                        CV_32FC1);
+    const float* rand_ptr = randprob.ptr<float>();
+    const float* threshold = &label_mask_probability_[0];
+    rng.FillUniform(randprob.ptr<float>(), label_count, MASK_RANDOM_BLOCK);
+
+    // Counting in the loop body: no omp simd (conflicting increments)
+    for (long i = 0; i < label_count; ++i) {
+      int l = (int) label_ptr[i];
+      float out = threshold[l] >= rand_ptr[i] ? label_value[l] : -1.0f;
+      label_ptr[i] = out;
+      ++counter[(int) out];
+    }
+  } else if (label_consolidate_) {
+    for (long i = 0; i < label_count; ++i) {
+      float out = label_value[(int) label_ptr[i]];
+      label_ptr[i] = out;
+      ++counter[(int) out];
+    }
+  } else {
+    for (long i = 0; i < label_count; ++i) {
+      ++counter[(int) label_ptr[i]];
+    }
+  }
+  for (unsigned int k = 0; k < local_counter.size(); ++k) {
+    if (local_counter[k] > 0) {
+#pragma omp atomic
+      label_counter_[k] += local_counter[k];
     }
   }
 
-
-  patch_label.push_back(patch);
-  patch_label.push_back(label);
-
-  return patch_label;
+  patch_label.resize(2);
+  patch_label[0] = patch;
+  patch_label[1] = label;
+  return abs_id;
 }
 
 }
@@ -0,0 +1,210 @@
+/*
+ * manifest.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "manifest.hpp"
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <unordered_map>
+
+namespace caffe_neural {
+
+// Whitespace separated token starting at pos, pos is moved past it
+static bool NextToken(const std::string &line, size_t &pos,
+                      std::string &token) {
+  size_t start = line.find_first_not_of(" \t\r", pos);
+  if (start == std::string::npos || line[start] == '#') {
+    return false;
+  }
+  size_t end = line.find_first_of(" \t\r#", start);
+  if (end == std::string::npos) {
+    end = line.size();
+  }
+  token.assign(line, start, end - start);
+  pos = end;
+  return true;
+}
+
+static bool ParseOption(const std::string &token, ManifestItem &item) {
+  if (token.compare(0, 6, "pages=") == 0) {
+    const char* str = token.c_str() + 6;
+    char* end;
+    item.first_page = std::strtol(str, &end, 10);
+    item.last_page = (*end == '-') ?
+        std::strtol(end + 1, &end, 10) : item.first_page;
+    return *end == '\0' && item.first_page >= 0
+        && item.last_page >= item.first_page;
+  }
+  if (token.compare(0, 7, "weight=") == 0) {
+    char* end;
+    item.weight = std::strtof(token.c_str() + 7, &end);
+    return *end == '\0' && item.weight > 0;
+  }
+  return false;
+}
+
+std::vector<ManifestItem> LoadManifest(std::string file, bool require_labels,
+                                       int* error) {
+  std::vector<ManifestItem> items;
+
+  // Large read buffer for network filesystems
+  std::vector<char> buffer(1 << 20);
+  std::ifstream in_file;
+  in_file.rdbuf()->pubsetbuf(&buffer[0], buffer.size());
+  in_file.open(file);
+  if (!in_file.is_open()) {
+    (*error) = FSU_ERR_NO_FOLDER;
+    return items;
+  }
+
+  bofs::path base = bofs::path(file).parent_path();
+
+  // Raw image stem to item indices (page ranges of one stack, or raw images
+  // of the same name in different folders)
+  std::unordered_map<std::string, std::vector<size_t>> stems;
+  std::vector<std::pair<std::string, bofs::path>> labels;
+
+  std::string line;
+  std::string kind;
+  std::string token;
+  long line_number = 0;
+  while (std::getline(in_file, line)) {
+    ++line_number;
+    size_t pos = 0;
+    if (!NextToken(line, pos, kind)) {
+      continue;
+    }
+    if (!NextToken(line, pos, token)) {
+      LOG(FATAL) << file << ":" << line_number << ": missing path";
+    }
+    bofs::path path(token);
+    if (path.is_relative()) {
+      path = base / path;
+    }
+
+    if (kind == "raw") {
+      ManifestItem item;
+      item.raw = path;
+      item.first_page = -1;
+      item.last_page = -1;
+      item.weight = 1.0;
+      while (NextToken(line, pos, token)) {
+        if (!ParseOption(token, item)) {
+          LOG(FATAL) << file << ":" << line_number << ": invalid option "
+                     << token;
+        }
+      }
+      stems[path.stem().string()].push_back(items.size());
+      items.push_back(item);
+    } else if (kind == "label") {
+      labels.push_back(std::make_pair(path.stem().string(), path));
+    } else {
+      LOG(FATAL) << file << ":" << line_number << ": unknown entry " << kind;
+    }
+  }
+
+  // Pair by stem (labels may be listed before their raw image)
+  long unpaired = 0;
+  for (unsigned int i = 0; i < labels.size(); ++i) {
+    std::unordered_map<std::string, std::vector<size_t>>::iterator it =
+        stems.find(labels[i].first);
+    if (it == stems.end()) {
+      ++unpaired;
+      continue;
+    }
+    for (unsigned int k = 0; k < it->second.size(); ++k) {
+      items[it->second[k]].labels.push_back(labels[i].second);
+    }
+  }
+  if (unpaired > 0) {
+    LOG(WARNING) << file << ": " << unpaired
+                 << " label images without raw image";
+  }
+
+  // Validate all files, stat calls in parallel (network filesystems)
+  std::vector<char> valid(items.size(), 1);
+#pragma omp parallel for schedule(dynamic, 16)
+  for (long i = 0; i < (long) items.size(); ++i) {
+    ManifestItem &item = items[i];
+    std::sort(item.labels.begin(), item.labels.end());
+    struct stat info;
+    bool missing = (stat(item.raw.c_str(), &info) != 0);
+    for (unsigned int k = 0; k < item.labels.size(); ++k) {
+      missing |= (stat(item.labels[k].c_str(), &info) != 0);
+    }
+    valid[i] = !missing && !(require_labels && item.labels.size() == 0);
+  }
+
+  std::vector<ManifestItem> valid_items;
+  for (unsigned int i = 0; i < items.size(); ++i) {
+    if (valid[i]) {
+      valid_items.push_back(items[i]);
+    } else {
+      LOG(WARNING) << "Manifest item " << items[i].raw
+                   << " has missing files or labels, skipped";
+      (*error) = FSU_ERR_MISSING_ITEMS;
+    }
+  }
+
+  // Consistent label count (the images are stacked per label)
+  for (unsigned int i = 1; i < valid_items.size(); ++i) {
+    if (valid_items[i].labels.size() != valid_items[0].labels.size()) {
+      LOG(FATAL) << "Manifest item " << valid_items[i].raw << " has "
+                 << valid_items[i].labels.size() << " label images, "
+                 << valid_items[0].raw << " has "
+                 << valid_items[0].labels.size();
+    }
+  }
+
+  return valid_items;
+}
+
+std::vector<ManifestItem> LoadInputItems(InputParam &input_param,
+                                         bool require_labels) {
+  int error = 0;
+  std::vector<ManifestItem> items;
+
+  if (input_param.has_manifest()) {
+    items = LoadManifest(input_param.manifest(), require_labels, &error);
+    if (error == FSU_ERR_NO_FOLDER) {
+      LOG(FATAL) << "Could not open manifest: " << input_param.manifest();
+    }
+  } else if (require_labels) {
+    std::vector<std::vector<bofs::path>> training_set = LoadTrainingSetItems(
+        CreateImageTypesSet(), input_param.raw_images(),
+        input_param.label_images(), &error);
+    for (unsigned int i = 0; i < training_set.size(); ++i) {
+      ManifestItem item = { training_set[i][0], std::vector<bofs::path>(
+          training_set[i].begin() + 1, training_set[i].end()), -1, -1, 1.0 };
+      items.push_back(item);
+    }
+  } else {
+    std::vector<bofs::path> process_set = LoadProcessSetItems(
+        CreateImageTypesSet(), input_param.raw_images(), &error);
+    for (unsigned int i = 0; i < process_set.size(); ++i) {
+      ManifestItem item = { process_set[i], std::vector<bofs::path>(), -1, -1,
+          1.0 };
+      items.push_back(item);
+    }
+  }
+
+  return items;
+}
+
+void SelectPages(const ManifestItem &item, std::vector<cv::Mat> &stack) {
+  if (item.first_page < 0) {
+    return;
+  }
+  if (item.last_page >= (int) stack.size()) {
+    LOG(FATAL) << "Page range " << item.first_page << "-" << item.last_page
+               << " exceeds the " << stack.size() << " pages of " << item.raw;
+  }
+  stack = std::vector<cv::Mat>(stack.begin() + item.first_page,
+                               stack.begin() + item.last_page + 1);
+}
+
+}  // namespace caffe_neural
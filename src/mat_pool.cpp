@@ -0,0 +1,56 @@
+/*
+ * mat_pool.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "mat_pool.hpp"
+#include <omp.h>
+#include <algorithm>
+
+namespace caffe_neural {
+
+// Counter stride in longs (one cache line)
+#define MAT_POOL_PAD 8
+
+MatPool::MatPool(int nr_slots)
+    : nr_slots_(nr_slots),
+      mats_(omp_get_max_threads() * nr_slots),
+      allocations_(omp_get_max_threads() * MAT_POOL_PAD),
+      requests_(omp_get_max_threads() * MAT_POOL_PAD) {
+}
+
+cv::Mat& MatPool::Get(int slot, int rows, int cols, int type) {
+  int thread = omp_get_thread_num();
+  cv::Mat &mat = mats_[thread * nr_slots_ + slot];
+  uchar* data = mat.data;
+  mat.create(rows, cols, type);
+  if (mat.data != data) {
+    ++allocations_[thread * MAT_POOL_PAD];
+  }
+  ++requests_[thread * MAT_POOL_PAD];
+  return mat;
+}
+
+long MatPool::allocations() {
+  long total = 0;
+  for (unsigned int i = 0; i < allocations_.size(); i += MAT_POOL_PAD) {
+    total += allocations_[i];
+  }
+  return total;
+}
+
+long MatPool::requests() {
+  long total = 0;
+  for (unsigned int i = 0; i < requests_.size(); i += MAT_POOL_PAD) {
+    total += requests_[i];
+  }
+  return total;
+}
+
+void MatPool::ResetStats() {
+  std::fill(allocations_.begin(), allocations_.end(), 0);
+  std::fill(requests_.begin(), requests_.end(), 0);
+}
+
+}  // namespace caffe_neural
@@ -0,0 +1,115 @@
+/*
+ * memory_data_buffer.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "memory_data_buffer.hpp"
+
+namespace caffe_neural {
+
+void WritePlanar(const cv::Mat &src, float* dst) {
+  // copyTo and mixChannels would silently reallocate the planes otherwise
+  CHECK_EQ(src.depth(), CV_32F) << "Input images must be CV_32F.";
+  if (src.channels() == 1) {
+    cv::Mat plane(src.rows, src.cols, CV_32FC1, dst);
+    src.copyTo(plane);
+    return;
+  }
+  // Layout conversion (HWC to CHW) happens in the same pass as the copy
+  for (int c = 0; c < src.channels(); ++c) {
+    cv::Mat plane(src.rows, src.cols, CV_32FC1, dst + c * src.rows * src.cols);
+    int from_to[] = { c, 0 };
+    cv::mixChannels(&src, 1, &plane, 1, from_to, 1);
+  }
+}
+
+// Reset() hands the buffer to the layer without running the data
+// transformer, so a transform_param on the input layer would be ignored.
+static void CheckNoTransform(
+    const shared_ptr<caffe::MemoryDataLayer<float>>& layer) {
+  if (layer->layer_param().has_transform_param()) {
+    LOG(FATAL)<< "Input layer " << layer->layer_param().name()
+        << " has a transform_param, which is not applied to buffered data."
+        << " Remove it and preprocess in the processor instead.";
+  }
+}
+
+MemoryDataBuffer::MemoryDataBuffer(shared_ptr<Layer<float>> layer)
+    : back_(0) {
+  layer_ = boost::dynamic_pointer_cast<caffe::MemoryDataLayer<float>>(layer);
+  if (layer_ == NULL) {
+    LOG(FATAL)<< "Input layer is not a MemoryDataLayer.";
+  }
+  CheckNoTransform(layer_);
+  sample_size_ = layer_->channels() * layer_->height() * layer_->width();
+  data_[0].resize(layer_->batch_size() * sample_size_);
+  data_[1].resize(layer_->batch_size() * sample_size_);
+  labels_.resize(layer_->batch_size(), 0.0);
+}
+
+void MemoryDataBuffer::AddLayer(shared_ptr<Layer<float>> layer) {
+  shared_ptr<caffe::MemoryDataLayer<float>> shared_layer =
+      boost::dynamic_pointer_cast<caffe::MemoryDataLayer<float>>(layer);
+  if (shared_layer == NULL) {
+    LOG(FATAL)<< "Input layer is not a MemoryDataLayer.";
+  }
+  CheckNoTransform(shared_layer);
+  if (shared_layer->batch_size() != layer_->batch_size()
+      || shared_layer->channels() != layer_->channels()
+      || shared_layer->height() != layer_->height()
+      || shared_layer->width() != layer_->width()) {
+    LOG(FATAL)<< "Input layer shapes differ: " << shared_layer->batch_size()
+        << "x" << shared_layer->channels() << "x" << shared_layer->height()
+        << "x" << shared_layer->width() << " vs. " << layer_->batch_size()
+        << "x" << layer_->channels() << "x" << layer_->height() << "x"
+        << layer_->width();
+  }
+  shared_layers_.push_back(shared_layer);
+}
+
+float* MemoryDataBuffer::sample(int n) {
+  return &(data_[back_][n * sample_size_]);
+}
+
+const float* MemoryDataBuffer::submitted(int n) {
+  return &(data_[1 - back_][n * sample_size_]);
+}
+
+void MemoryDataBuffer::Write(int n, const cv::Mat &src) {
+  CHECK_GE(n, 0);
+  CHECK_LT(n, layer_->batch_size());
+  CHECK_EQ(src.channels() * src.rows * src.cols, sample_size_)
+      << "Input image " << src.channels() << "x" << src.rows << "x"
+      << src.cols << " does not match the input layer "
+      << layer_->channels() << "x" << layer_->height() << "x"
+      << layer_->width();
+  WritePlanar(src, sample(n));
+}
+
+void MemoryDataBuffer::Submit() {
+  layer_->Reset(&(data_[back_][0]), &(labels_[0]), layer_->batch_size());
+  for (unsigned int i = 0; i < shared_layers_.size(); ++i) {
+    shared_layers_[i]->Reset(&(data_[back_][0]), &(labels_[0]),
+                             layer_->batch_size());
+  }
+  back_ = 1 - back_;
+}
+
+int MemoryDataBuffer::num() {
+  return layer_->batch_size();
+}
+
+int MemoryDataBuffer::channels() {
+  return layer_->channels();
+}
+
+int MemoryDataBuffer::height() {
+  return layer_->height();
+}
+
+int MemoryDataBuffer::width() {
+  return layer_->width();
+}
+
+}  // namespace caffe_neural
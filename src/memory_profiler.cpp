@@ -0,0 +1,151 @@
+/*
+ * memory_profiler.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "memory_profiler.hpp"
+#include "utils.hpp"
+#include <glog/logging.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+namespace caffe_neural {
+
+bool MemoryProfiler::enabled_ = false;
+
+// Current resident set size in kB
+static long CurrentRSS() {
+  long pages = 0;
+  long resident = 0;
+  std::ifstream statm("/proc/self/statm");
+  statm >> pages >> resident;
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+MemoryProfiler::MemoryProfiler()
+    : interval_ms_(100),
+      phase_("startup"),
+      running_(false) {
+}
+
+MemoryProfiler& MemoryProfiler::Get() {
+  static MemoryProfiler profiler;
+  return profiler;
+}
+
+void MemoryProfiler::Start(std::string file, int interval_ms) {
+  file_ = file;
+  interval_ms_ = std::max(interval_ms, 1);
+  start_ = std::chrono::steady_clock::now();
+  running_ = true;
+  enabled_ = true;
+  Sample();
+
+  thread_ = std::thread([this]() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+      stop_.wait_for(lock, std::chrono::milliseconds(interval_ms_));
+      lock.unlock();
+      Sample();
+      lock.lock();
+    }
+  });
+}
+
+void MemoryProfiler::Stop() {
+  if (!enabled_) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  stop_.notify_all();
+  thread_.join();
+  enabled_ = false;
+  Write();
+}
+
+const char* MemoryProfiler::phase() {
+  return phase_;
+}
+
+void MemoryProfiler::SetPhase(const char* phase) {
+  phase_ = phase;
+  if (enabled_) {
+    Sample();
+  }
+}
+
+void MemoryProfiler::Sample() {
+  MemorySample sample;
+  sample.time = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start_).count();
+  sample.phase = phase_;
+  sample.rss = CurrentRSS();
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || \
+    (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 info = mallinfo2();
+#else
+  struct mallinfo info = mallinfo();
+#endif
+  sample.heap_used = info.uordblks / 1024;
+  sample.heap_mapped = info.hblkhd / 1024;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  samples_.push_back(sample);
+}
+
+void MemoryProfiler::Write() {
+  std::ofstream out_file(file_, std::ios::out);
+  if (!out_file.is_open()) {
+    LOG(ERROR) << "Could not write memory timeline: " << file_;
+    return;
+  }
+
+  // Peaks per phase, in order of appearance
+  std::vector<const char*> phases;
+  std::map<std::string, MemorySample> peaks;
+
+  for (unsigned int i = 0; i < samples_.size(); ++i) {
+    MemorySample &sample = samples_[i];
+    out_file << sample.time << ";" << sample.phase << ";" << sample.rss << ";"
+             << sample.heap_used << ";" << sample.heap_mapped << std::endl;
+
+    if (peaks.find(sample.phase) == peaks.end()) {
+      phases.push_back(sample.phase);
+      peaks[sample.phase] = sample;
+    }
+    MemorySample &peak = peaks[sample.phase];
+    peak.rss = std::max(peak.rss, sample.rss);
+    peak.heap_used = std::max(peak.heap_used, sample.heap_used);
+    peak.heap_mapped = std::max(peak.heap_mapped, sample.heap_mapped);
+  }
+
+  std::string stem = file_.substr(0, file_.rfind('.'));
+  std::ofstream phase_file(stem + "_phases.csv", std::ios::out);
+  for (unsigned int i = 0; i < phases.size(); ++i) {
+    MemorySample &peak = peaks[phases[i]];
+    phase_file << phases[i] << ";" << peak.rss << ";" << peak.heap_used << ";"
+               << peak.heap_mapped << std::endl;
+  }
+  phase_file << "process;" << GetPeakRSS() << std::endl;
+
+  LOG(INFO) << "Memory timeline written (" << samples_.size()
+            << " samples): " << file_;
+}
+
+MemoryPhase::MemoryPhase(const char* phase)
+    : previous_(MemoryProfiler::Get().phase()) {
+  MemoryProfiler::Get().SetPhase(phase);
+}
+
+MemoryPhase::~MemoryPhase() {
+  MemoryProfiler::Get().SetPhase(previous_);
+}
+
+}  // namespace caffe_neural
@@ -0,0 +1,187 @@
+/*
+ * perf_counters.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "perf_counters.hpp"
+#include <glog/logging.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <omp.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+namespace caffe_neural {
+
+static int OpenEvent(int type, int config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+      | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr.exclude_hv = 1;
+  // Calling thread, any CPU
+  int fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  if (fd < 0) {
+    // Restricted perf_event_paranoid: user space only
+    attr.exclude_kernel = 1;
+    fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+  return fd;
+}
+
+PerfCounters::PerfCounters()
+    : hardware_(false) {
+}
+
+PerfCounters::~PerfCounters() {
+  Close();
+}
+
+bool PerfCounters::OpenSet(const std::vector<std::pair<int, int>> &events) {
+  fds_.resize(omp_get_max_threads());
+  bool success = true;
+#pragma omp parallel num_threads(fds_.size()) reduction(&&:success)
+  {
+    std::vector<int> &fds = fds_[omp_get_thread_num()];
+    for (unsigned int e = 0; e < events.size(); ++e) {
+      int fd = OpenEvent(events[e].first, events[e].second);
+      if (fd < 0) {
+        success = false;
+        break;
+      }
+      fds.push_back(fd);
+    }
+  }
+  if (!success) {
+    Close();
+  }
+  return success;
+}
+
+bool PerfCounters::Open() {
+  Close();
+
+  std::vector<std::pair<int, int>> hw_events = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES }
+  };
+  if (OpenSet(hw_events)) {
+    hardware_ = true;
+    names_ = { "cycles", "instructions", "cache_misses" };
+    return true;
+  }
+
+  std::vector<std::pair<int, int>> sw_events = {
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS }
+  };
+  if (OpenSet(sw_events)) {
+    LOG(WARNING) << "Hardware performance counters not available, "
+                 << "using task clock and page faults";
+    names_ = { "task_clock", "page_faults" };
+    return true;
+  }
+
+  LOG(WARNING) << "Performance counters not available (perf_event_open: "
+               << strerror(errno) << ")";
+  return false;
+}
+
+void PerfCounters::Reopen() {
+  if (enabled()) {
+    Open();
+  }
+}
+
+void PerfCounters::Close() {
+  for (unsigned int t = 0; t < fds_.size(); ++t) {
+    for (unsigned int e = 0; e < fds_[t].size(); ++e) {
+      close(fds_[t][e]);
+    }
+  }
+  fds_.clear();
+  names_.clear();
+  hardware_ = false;
+}
+
+bool PerfCounters::enabled() const {
+  return names_.size() > 0;
+}
+
+bool PerfCounters::hardware() const {
+  return hardware_;
+}
+
+std::vector<std::string> PerfCounters::columns() const {
+  std::vector<std::string> columns = names_;
+  if (hardware_) {
+    columns.push_back("IPC");
+  }
+  return columns;
+}
+
+std::vector<double> PerfCounters::Read() {
+  std::vector<double> values(names_.size(), 0.0);
+  for (unsigned int t = 0; t < fds_.size(); ++t) {
+    for (unsigned int e = 0; e < fds_[t].size(); ++e) {
+      // value, time enabled, time running
+      uint64_t data[3];
+      if (read(fds_[t][e], data, sizeof(data)) != sizeof(data)
+          || data[2] == 0) {
+        continue;
+      }
+      values[e] += (double) data[0] * ((double) data[1] / (double) data[2]);
+    }
+  }
+  return values;
+}
+
+PerfScope::PerfScope(PerfCounters *counters, PerfCounts *counts,
+                     long samples)
+    : counters_(counters),
+      counts_(counts),
+      samples_(samples) {
+  if (counters_ != nullptr && counts_ != nullptr && counters_->enabled()) {
+    start_ = counters_->Read();
+  }
+}
+
+PerfScope::~PerfScope() {
+  if (start_.size() == 0) {
+    return;
+  }
+  std::vector<double> end = counters_->Read();
+  if (counts_->sum.size() != end.size()) {
+    counts_->sum.assign(end.size(), 0.0);
+    counts_->samples = 0;
+  }
+  for (unsigned int e = 0; e < end.size(); ++e) {
+    counts_->sum[e] += end[e] - start_[e];
+  }
+  counts_->samples += samples_;
+}
+
+void WritePerfCounts(std::ostream &out, const PerfCounters &counters,
+                     const PerfCounts &counts) {
+  std::vector<std::string> columns = counters.columns();
+  bool valid = counts.samples > 0 && counts.sum.size() > 0;
+  for (unsigned int e = 0; e < columns.size(); ++e) {
+    if (!valid) {
+      out << ";0";
+    } else if (e < counts.sum.size()) {
+      out << ";" << counts.sum[e] / counts.samples;
+    } else {
+      // Instructions per cycle
+      out << ";" << (counts.sum[0] > 0 ? counts.sum[1] / counts.sum[0] : 0.0);
+    }
+  }
+}
+
+}  // namespace caffe_neural
@@ -0,0 +1,191 @@
+/*
+ * pipeline_stats.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "pipeline_stats.hpp"
+#include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+namespace caffe_neural {
+
+static int BucketIndex(double seconds) {
+  double us = seconds * 1e6;
+  if (us <= 1.0) {
+    return 0;
+  }
+  int bucket = (int) (std::log2(us) * STATS_BUCKETS_PER_OCTAVE) + 1;
+  return std::min(bucket, STATS_BUCKETS - 1);
+}
+
+// Upper bound of a bucket in seconds
+static double BucketLimit(int bucket) {
+  return std::pow(2.0, (double) bucket / STATS_BUCKETS_PER_OCTAVE) * 1e-6;
+}
+
+PipelineStats::PipelineStats()
+    : threads_(omp_get_max_threads()),
+      json_(false),
+      last_iteration_(0),
+      last_patches_(0),
+      last_time_(std::chrono::steady_clock::now()) {
+}
+
+int PipelineStats::AddStage(std::string name) {
+  for (unsigned int i = 0; i < names_.size(); ++i) {
+    if (names_[i] == name) {
+      return i;
+    }
+  }
+  names_.push_back(name);
+  StageHistogram hist;
+  hist.buckets.resize(STATS_BUCKETS);
+  for (unsigned int t = 0; t < threads_.size(); ++t) {
+    threads_[t].push_back(hist);
+  }
+  Reset();
+  return names_.size() - 1;
+}
+
+void PipelineStats::Record(int stage, double seconds) {
+  StageHistogram &hist = threads_[omp_get_thread_num()][stage];
+  ++hist.count;
+  hist.sum += seconds;
+  hist.max = std::max(hist.max, seconds);
+  ++hist.buckets[BucketIndex(seconds)];
+}
+
+void PipelineStats::Open(std::string file, std::string format) {
+  json_ = (format == "json");
+  out_file_.open(file, std::ios::out | std::ios::app);
+  if (!out_file_.is_open()) {
+    LOG(FATAL) << "Could not open statistics output: " << file;
+  }
+}
+
+StageHistogram PipelineStats::Merge(int stage) {
+  StageHistogram merged = threads_[0][stage];
+  for (unsigned int t = 1; t < threads_.size(); ++t) {
+    StageHistogram &hist = threads_[t][stage];
+    merged.count += hist.count;
+    merged.sum += hist.sum;
+    merged.max = std::max(merged.max, hist.max);
+    for (int b = 0; b < STATS_BUCKETS; ++b) {
+      merged.buckets[b] += hist.buckets[b];
+    }
+  }
+  return merged;
+}
+
+void PipelineStats::Reset() {
+  for (unsigned int t = 0; t < threads_.size(); ++t) {
+    for (unsigned int s = 0; s < threads_[t].size(); ++s) {
+      StageHistogram &hist = threads_[t][s];
+      hist.count = 0;
+      hist.sum = 0;
+      hist.max = 0;
+      std::fill(hist.buckets.begin(), hist.buckets.end(), 0);
+    }
+  }
+}
+
+double PipelineStats::Percentile(int stage, double q) {
+  StageHistogram hist = Merge(stage);
+  long rank = (long) std::ceil(q * hist.count);
+  long seen = 0;
+  for (int b = 0; b < STATS_BUCKETS; ++b) {
+    seen += hist.buckets[b];
+    if (seen >= rank && seen > 0) {
+      return std::min(BucketLimit(b), hist.max);
+    }
+  }
+  return hist.max;
+}
+
+double PipelineStats::Total(int stage) {
+  return Merge(stage).sum;
+}
+
+void PipelineStats::Dump(long iteration, long patches) {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  double elapsed = std::chrono::duration<double>(now - last_time_).count();
+  double iter_rate = (iteration - last_iteration_) / elapsed;
+  double patch_rate = (patches - last_patches_) / elapsed;
+
+  LOG(INFO) << "Pipeline: " << iter_rate << " iterations/s, " << patch_rate
+            << " patches/s";
+
+  if (out_file_.is_open()) {
+    out_file_ << std::setprecision(10);
+    if (json_) {
+      out_file_ << "{\"iteration\":" << iteration << ",\"iterations_per_s\":"
+                << iter_rate << ",\"patches_per_s\":" << patch_rate
+                << ",\"stages\":{";
+    }
+    for (unsigned int s = 0; s < names_.size(); ++s) {
+      StageHistogram hist = Merge(s);
+      double mean = hist.count > 0 ? hist.sum / hist.count : 0;
+      if (json_) {
+        out_file_ << (s > 0 ? "," : "") << "\"" << names_[s] << "\":{"
+                  << "\"count\":" << hist.count
+                  << ",\"mean_ms\":" << mean * 1e3
+                  << ",\"p50_ms\":" << Percentile(s, 0.5) * 1e3
+                  << ",\"p90_ms\":" << Percentile(s, 0.9) * 1e3
+                  << ",\"p99_ms\":" << Percentile(s, 0.99) * 1e3
+                  << ",\"max_ms\":" << hist.max * 1e3 << "}";
+      } else {
+        out_file_ << iteration << ";" << names_[s] << ";" << hist.count << ";"
+                  << mean * 1e3 << ";" << Percentile(s, 0.5) * 1e3 << ";"
+                  << Percentile(s, 0.9) * 1e3 << ";"
+                  << Percentile(s, 0.99) * 1e3 << ";" << hist.max * 1e3 << ";"
+                  << iter_rate << ";" << patch_rate << std::endl;
+      }
+    }
+    if (json_) {
+      out_file_ << "}}" << std::endl;
+    }
+  }
+
+  Reset();
+  last_iteration_ = iteration;
+  last_patches_ = patches;
+  last_time_ = now;
+}
+
+StageTimer::StageTimer(PipelineStats *stats, int stage)
+    : stats_(stats),
+      stage_(stage) {
+  if (stats_ != nullptr) {
+    start_ = std::chrono::steady_clock::now();
+  }
+}
+
+StageTimer::~StageTimer() {
+  if (stats_ != nullptr) {
+    stats_->Record(
+        stage_,
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start_)
+            .count());
+  }
+}
+
+SolverStageTimer::SolverStageTimer(PipelineStats *stats)
+    : stats_(stats) {
+  stage_forward_backward_ = stats_->AddStage("forward_backward");
+}
+
+void SolverStageTimer::on_start() {
+  start_ = std::chrono::steady_clock::now();
+}
+
+void SolverStageTimer::on_gradients_ready() {
+  stats_->Record(
+      stage_forward_backward_,
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start_)
+          .count());
+}
+
+}  // namespace caffe_neural
@@ -7,106 +7,238 @@
 
 #include "process.hpp"
 #include "filesystem_utils.hpp"
+#include "manifest.hpp"
+#include "work_claims.hpp"
+#include "process_checkpoint.hpp"
 #include "utils.hpp"
-#include "caffe/layers/memory_data_layer.hpp"
+#include "memory_data_buffer.hpp"
+#include "filter_exporter.hpp"
+#include "trace.hpp"
+#include "memory_profiler.hpp"
+#include "pipeline_stats.hpp"
+#include <memory>
 
 namespace caffe_neural {
 
-int ExportFilters(Net<float> *net, std::string output_folder,
-                  bofs::path input_name, int st, int y, int x, bool store_diff) {
-  std::vector<std::string> names = net->blob_names();
-  std::vector<boost::shared_ptr<Blob<float>>>blobs = net->blobs();
+void ScatterTile(const float* tile, int patch_size, int yoff, int xoff,
+                 unsigned int label_offset, double scale,
+                 std::vector<cv::Mat> &outimgs) {
+  if (outimgs.size() == 0) {
+    return;
+  }
+
+  // Clip the tile at the image edges
+  int y0 = std::max(0, -yoff);
+  int x0 = std::max(0, -xoff);
+  int y1 = std::min(patch_size, outimgs[0].rows - yoff);
+  int x1 = std::min(patch_size, outimgs[0].cols - xoff);
+  int rows = y1 - y0;
+  if (rows <= 0 || x1 <= x0) {
+    return;
+  }
+
+  // One row at a time over all labels, convertTo does the (vectorized)
+  // conversion to the output type in the same pass as the copy
+#pragma omp parallel for
+  for (int r = 0; r < (int) outimgs.size() * rows; ++r) {
+    int k = r / rows;
+    int y = y0 + r % rows;
+    cv::Mat src(1, x1 - x0, CV_32FC1,
+                const_cast<float*>(tile)
+                    + ((k + label_offset) * patch_size + y) * patch_size + x0);
+    cv::Mat dst = outimgs[k](cv::Rect(xoff + x0, yoff + y, x1 - x0, 1));
+    src.convertTo(dst, outimgs[k].type(), scale, 0.0);
+  }
+}
 
-  for (unsigned int i = 0; i < names.size(); ++i) {
-    std::string name = names[i];
-    shared_ptr<Blob<float>> blob = blobs[i];
+void ProcessTiles(Net<float> &net, MemoryDataBuffer &input_buffer,
+                  const cv::Mat &padimage, int patch_size, int padding_size,
+                  int imagecrop, unsigned int label_offset, double scale,
+                  std::vector<cv::Mat> &outimgs,
+                  std::function<void(int, int, int)> tile_callback,
+                  PipelineStats *stats, int first_tile) {
+  ProcessTiles(std::vector<Net<float>*> { &net }, std::vector<float> { 1.0 },
+               input_buffer, padimage, patch_size, padding_size, imagecrop,
+               label_offset, scale, outimgs, tile_callback, stats, first_tile);
+}
 
-    const float* cpu_ptr = blob->cpu_data();
-    const float* cpu_diff_ptr = nullptr;
-    if (store_diff) {
-      cpu_diff_ptr = blob->cpu_diff();
+void ProcessTiles(const std::vector<Net<float>*> &nets,
+                  const std::vector<float> &weights,
+                  MemoryDataBuffer &input_buffer,
+                  const cv::Mat &padimage, int patch_size, int padding_size,
+                  int imagecrop, unsigned int label_offset, double scale,
+                  std::vector<cv::Mat> &outimgs,
+                  std::function<void(int, int, int)> tile_callback,
+                  PipelineStats *stats, int first_tile) {
+  int stage_input = 0;
+  int stage_forward = 0;
+  int stage_ensemble = 0;
+  int stage_scatter = 0;
+  if (stats != nullptr) {
+    stage_input = stats->AddStage("tile_input");
+    stage_forward = stats->AddStage("forward");
+    if (nets.size() > 1) {
+      stage_ensemble = stats->AddStage("ensemble");
     }
+    stage_scatter = stats->AddStage("scatter");
+  }
 
-    for (int n = 0; n < blob->num(); ++n) {
-      for (int c = 0; c < blob->channels(); ++c) {
+  // Weighted average of the member outputs
+  float weight_sum = 0.0;
+  for (unsigned int m = 0; m < weights.size(); ++m) {
+    weight_sum += weights[m];
+  }
+  if (weights.size() != nets.size() || !(weight_sum > 0.0)) {
+    LOG(FATAL) << "Invalid ensemble weights";
+  }
+  std::vector<float> ensemble;
 
-        cv::Mat mat(blob->height(), blob->width(), CV_32FC1);
-        cv::Mat matd(blob->height(), blob->width(), CV_32FC1);
+  int image_size_x = outimgs[0].cols;
+  int image_size_y = outimgs[0].rows;
 
+  // Tile offsets (pixels) and tile indices
+  std::vector<cv::Vec<int, 4>> tiles;
+  for (int yoff = 0; yoff < (image_size_y - 1) / patch_size + 1; ++yoff) {
+    for (int xoff = 0; xoff < (image_size_x - 1) / patch_size + 1; ++xoff) {
 
-        for (int h = 0; h < blob->height(); ++h) {
-#pragma omp parallel for
-          for (int w = 0; w < blob->width(); ++w) {
-            mat.at<float>(h, w) = *(cpu_ptr + w);
-          }
-          cpu_ptr += blob->width();
-        }
+      int xoffp = xoff * patch_size;
+      int yoffp = yoff * patch_size;
 
-        if (store_diff) {
-          for (int h = 0; h < blob->height(); ++h) {
-  #pragma omp parallel for
-            for (int w = 0; w < blob->width(); ++w) {
-              matd.at<float>(h, w) = *(cpu_diff_ptr + w);
-            }
-            cpu_diff_ptr += blob->width();
-          }
-        }
+      if(xoffp + patch_size > image_size_x) {
+        xoffp = std::max(image_size_x - patch_size, 0);
+      }
 
-        bofs::path outp(output_folder);
+      if(yoffp + patch_size > image_size_y) {
+        yoffp = std::max(image_size_y - patch_size, 0);
+      }
 
-        std::stringstream ssp;
-        ssp << "/";
-        ssp << input_name.stem().string();
-        ssp << "_" << st << "_" << y << "_" << x;
+      cv::Vec<int, 4> tile;
+      tile[0] = yoffp;
+      tile[1] = xoffp;
+      tile[2] = yoff;
+      tile[3] = xoff;
+      tiles.push_back(tile);
+    }
+  }
 
-        std::stringstream ssf;
-        ssf << "/";
-        ssf << name;
-        ssf << "_" << n << "_" << c;
-        ssf << ".png";
+  // Process as many tiles per forward pass as the network batch holds
+  int batch_size = input_buffer.num();
+  for (unsigned int t = first_tile; t < tiles.size(); t += batch_size) {
+    TraceScope trace("tile");
+    int batch_tiles = std::min(batch_size, (int) (tiles.size() - t));
+
+    {
+      StageTimer timer(stats, stage_input);
+      for (int n = 0; n < batch_tiles; ++n) {
+        cv::Rect roi(tiles[t + n][1], tiles[t + n][0],
+            padding_size + patch_size - imagecrop,
+            padding_size + patch_size - imagecrop);
+        input_buffer.Write(n, padimage(roi));
+      }
+      input_buffer.Submit();
+    }
 
-        std::stringstream ssfd;
-        ssfd << "/";
-        ssfd << name;
-        ssfd << "_" << n << "_" << c << "_diff";
-        ssfd << ".png";
+    const float* cpuresult = nullptr;
+    int tile_stride = 0;
+    for (unsigned int m = 0; m < nets.size(); ++m) {
+      const float* memberresult = nullptr;
+      int member_stride = 0;
+      {
+        StageTimer timer(stats, stage_forward);
+        float loss = 0.0;
+        const vector<Blob<float>*>& result = nets[m]->ForwardPrefilled(&loss);
+        memberresult = result[0]->cpu_data();
+        member_stride = result[0]->count() / result[0]->num();
+      }
+      if (nets.size() == 1) {
+        cpuresult = memberresult;
+        tile_stride = member_stride;
+        break;
+      }
 
-        bofs::path outpl = outp;
-        outpl /= (ssp.str());
-        bofs::create_directories(outpl);
-        bofs::path filep = outpl;
-        filep /= (ssf.str());
+      // All members write the same outputs, accumulated in tile space (the
+      // scatter and output conversion happen once)
+      StageTimer timer(stats, stage_ensemble);
+      if (m == 0) {
+        tile_stride = member_stride;
+        ensemble.resize(batch_size * tile_stride);
+      } else if (member_stride != tile_stride) {
+        LOG(FATAL) << "Ensemble member " << m << " output size "
+                   << member_stride << " differs from " << tile_stride;
+      }
+      float weight = weights[m] / weight_sum;
+      long count = (long) batch_tiles * tile_stride;
+      if (m == 0) {
+#pragma omp parallel for
+        for (long j = 0; j < count; ++j) {
+          ensemble[j] = weight * memberresult[j];
+        }
+      } else {
+#pragma omp parallel for
+        for (long j = 0; j < count; ++j) {
+          ensemble[j] += weight * memberresult[j];
+        }
+      }
+      cpuresult = &ensemble[0];
+    }
 
-        bofs::path filepd = outpl;
-        filepd /= (ssfd.str());
+    {
+      StageTimer timer(stats, stage_scatter);
+      for (int n = 0; n < batch_tiles; ++n) {
+        ScatterTile(cpuresult + n * tile_stride, patch_size, tiles[t + n][0],
+                    tiles[t + n][1], label_offset, scale, outimgs);
+      }
+    }
 
-        cv::Mat outfc;
-        cv::Mat outuc;
+    if (tile_callback) {
+      tile_callback(tiles[t][2], tiles[t][3], t + batch_tiles);
+    }
+  }
+}
 
-        {
-          double minVal, maxVal;
-          cv::minMaxLoc(mat, &minVal, &maxVal);
+int SetupProcessImageProcessor(ProcessImageProcessor &image_processor,
+                               InputParam &input_param) {
+  int padding_size = input_param.padding_size();
+  unsigned int nr_labels = input_param.labels();
 
-          mat.convertTo(outfc, CV_32FC1, 1.0 / (maxVal - minVal),
-                    -minVal * 1.0 / (maxVal - minVal));
-          outfc.convertTo(outuc, CV_8UC1, 255.0, 0.0);
+  int imagecrop = 0;
+  if(input_param.has_preprocessor()) {
 
-          cv::imwrite(filep.string(), outuc);
-        }
-        if (store_diff) {
-          double minVal, maxVal;
-          cv::minMaxLoc(matd, &minVal, &maxVal);
+    PreprocessorParam preprocessor_param = input_param.preprocessor();
 
-          matd.convertTo(outfc, CV_32FC1, 1.0 / (maxVal - minVal),
-                    -minVal * 1.0 / (maxVal - minVal));
-          outfc.convertTo(outuc, CV_8UC1, 255.0, 0.0);
+    image_processor.SetBorderParams(input_param.has_padding_size(), padding_size / 2);
+    image_processor.SetRotationParams(preprocessor_param.has_rotation() && preprocessor_param.rotation());
+    image_processor.SetPatchMirrorParams(preprocessor_param.has_mirror() && preprocessor_param.mirror());
+    image_processor.SetNormalizationParams(preprocessor_param.has_normalization() && preprocessor_param.normalization());
+    image_processor.SetScaleParams(preprocessor_param.has_scale() && preprocessor_param.scale());
+    image_processor.SetTranslateParams(preprocessor_param.has_translate() && preprocessor_param.translate());
 
-          cv::imwrite(filepd.string(), outuc);
-        }
+    if(preprocessor_param.has_histeq()) {
+      PrepHistEqParam histeq_param = preprocessor_param.histeq();
+      std::vector<float> label_boost(nr_labels, 1.0);
+      for(int i = 0; i < histeq_param.label_boost().size(); ++i) {
+        label_boost[i] = histeq_param.label_boost().Get(i);
       }
+      image_processor.SetLabelHistEqParams(true, histeq_param.has_patch_prior()&&histeq_param.patch_prior(), histeq_param.has_masking()&&histeq_param.masking(), label_boost);
+    }
+
+    if(preprocessor_param.has_crop()) {
+      PrepCropParam crop_param = preprocessor_param.crop();
+      image_processor.SetCropParams(crop_param.has_imagecrop()?crop_param.imagecrop():0, crop_param.has_labelcrop()?crop_param.labelcrop():0);
+      imagecrop = crop_param.has_imagecrop()?crop_param.imagecrop():0;
+    }
+
+    if(preprocessor_param.has_clahe()) {
+      PrepClaheParam clahe_param = preprocessor_param.clahe();
+      image_processor.SetClaheParams(true, clahe_param.has_clip()?clahe_param.clip():4.0);
+    }
+
+    if(preprocessor_param.has_blur()) {
+      PrepBlurParam blur_param = preprocessor_param.blur();
+      image_processor.SetBlurParams(true, blur_param.has_mean()?blur_param.mean():0.0, blur_param.has_std()?blur_param.std():0.1, blur_param.has_ksize()?blur_param.ksize():5);
     }
   }
-  return 0;
+  return imagecrop;
 }
 
 int Process(caffe_neural::ToolParam &tool_param, CommonSettings &settings) {
@@ -156,66 +288,114 @@ int Process(caffe_neural::ToolParam &tool_param, CommonSettings &settings) {
     net.CopyTrainedLayersFrom(caffe_model);
   }
 
+  // Ensemble members share the input buffer, tiles are extracted once
+  std::vector<std::unique_ptr<Net<float>>> members;
+  std::vector<Net<float>*> nets { &net };
+  std::vector<float> weights { process_param.weight() };
+  for (int m = 0; m < process_param.ensemble_size(); ++m) {
+    const EnsembleMemberParam &member_param = process_param.ensemble(m);
+    if (!member_param.has_process_net()) {
+      LOG(FATAL) << "Ensemble member " << m << ": network prototxt missing.";
+    }
+    members.emplace_back(new Net<float>(member_param.process_net(),
+                                        caffe::TEST,
+                                        Caffe::GetDefaultDevice()));
+    if (member_param.has_caffemodel()) {
+      members.back()->CopyTrainedLayersFrom(member_param.caffemodel());
+    }
+    nets.push_back(members.back().get());
+    weights.push_back(member_param.weight());
+  }
+  if (nets.size() > 1) {
+    LOG(INFO) << "Ensemble of " << nets.size() << " networks";
+  }
+
   ProcessImageProcessor image_processor(patch_size, nr_labels);
+  MemoryDataBuffer input_buffer(net.layers()[0]);
+  for (unsigned int m = 1; m < nets.size(); ++m) {
+    input_buffer.AddLayer(nets[m]->layers()[0]);
+  }
+  FilterExporter filter_exporter(process_param.filter_output());
 
-  int imagecrop = 0;
-  if(input_param.has_preprocessor()) {
+  int imagecrop = SetupProcessImageProcessor(image_processor, input_param);
 
-    PreprocessorParam preprocessor_param = input_param.preprocessor();
+  unsigned int nr_out_labels = ((output_param.has_out_all_labels() && output_param.out_all_labels()) || nr_labels > 2)?nr_labels:1;
 
-    image_processor.SetBorderParams(input_param.has_padding_size(), padding_size / 2);
-    image_processor.SetRotationParams(preprocessor_param.has_rotation() && preprocessor_param.rotation());
-    image_processor.SetPatchMirrorParams(preprocessor_param.has_mirror() && preprocessor_param.mirror());
-    image_processor.SetNormalizationParams(preprocessor_param.has_normalization() && preprocessor_param.normalization());
-    image_processor.SetScaleParams(preprocessor_param.has_scale() && preprocessor_param.scale());
-    image_processor.SetTranslateParams(preprocessor_param.has_translate() && preprocessor_param.translate());
+  // In the two label case, export the second and not the first label output
+  unsigned int label_offset = nr_out_labels==1?1:0;
 
-    if(preprocessor_param.has_histeq()) {
-      PrepHistEqParam histeq_param = preprocessor_param.histeq();
-      std::vector<float> label_boost(nr_labels, 1.0);
-      for(int i = 0; i < histeq_param.label_boost().size(); ++i) {
-        label_boost[i] = histeq_param.label_boost().Get(i);
-      }
-      image_processor.SetLabelHistEqParams(true, histeq_param.has_patch_prior()&&histeq_param.patch_prior(), histeq_param.has_masking()&&histeq_param.masking(), label_boost);
-    }
+  std::vector<WorkUnit> units = MakeWorkUnits(
+      LoadInputItems(input_param, false), settings.unit_pages);
+  if (settings.shard_count > 1) {
+    units = ShardWorkUnits(units, settings.shard_index, settings.shard_count);
+    LOG(INFO) << "Shard " << settings.shard_index << "/"
+              << settings.shard_count << ": " << units.size() << " units";
+  }
 
-    if(preprocessor_param.has_crop()) {
-      PrepCropParam crop_param = preprocessor_param.crop();
-      image_processor.SetCropParams(crop_param.has_imagecrop()?crop_param.imagecrop():0, crop_param.has_labelcrop()?crop_param.labelcrop():0);
-      imagecrop = crop_param.has_imagecrop()?crop_param.imagecrop():0;
-    }
+  std::vector<bofs::path> process_set;
+  for (unsigned int i = 0; i < units.size(); ++i) {
+    process_set.push_back(units[i].item.raw);
+  }
 
-    if(preprocessor_param.has_clahe()) {
-      PrepClaheParam clahe_param = preprocessor_param.clahe();
-      image_processor.SetClaheParams(true, clahe_param.has_clip()?clahe_param.clip():4.0);
-    }
+  // Dynamic claims shared with other instances, otherwise all units in order
+  std::unique_ptr<WorkClaims> claims;
+  if (settings.claim_dir.size() > 0) {
+    claims.reset(new WorkClaims(settings.claim_dir, settings.claim_timeout));
+  }
+  int next_unit = 0;
 
-    if(preprocessor_param.has_blur()) {
-      PrepBlurParam blur_param = preprocessor_param.blur();
-      image_processor.SetBlurParams(true, blur_param.has_mean()?blur_param.mean():0.0, blur_param.has_std()?blur_param.std():0.1, blur_param.has_ksize()?blur_param.ksize():5);
+  // Checkpoints per unit in <output>/.checkpoint/<unit name>
+  bool checkpointing = output_param.checkpoint() || settings.resume;
+  bofs::path checkpoint_path = bofs::path(outpath) / ".checkpoint";
+
+  while (true) {
+    int i = claims ? claims->Next(units) :
+        (next_unit < (int) units.size() ? next_unit++ : -1);
+    if (i < 0) {
+      break;
     }
-  }
 
-  int error;
-  std::vector<bofs::path> process_set = LoadProcessSetItems(filetypes, input_param.raw_images(),&error);
+    std::unique_ptr<ProcessCheckpoint> checkpoint;
+    if (checkpointing) {
+      checkpoint.reset(new ProcessCheckpoint(
+          (checkpoint_path / units[i].name).string(),
+          output_param.checkpoint_interval()));
+      if (!settings.resume) {
+        checkpoint->Clear();
+      } else if (checkpoint->complete()) {
+        LOG(INFO) << "Skipping finished unit: " << units[i].name;
+        if (claims) {
+          claims->Done();
+        }
+        continue;
+      }
+    }
 
-  for (unsigned int i = 0; i < process_set.size(); ++i) {
-    LOG(INFO) << "Processing file: " << process_set[i];
+    LOG(INFO) << "Processing file: " << process_set[i] << " (" << units[i].name
+              << ")";
+    MemoryProfiler::Get().SetPhase("load");
 
     std::vector<cv::Mat> image_stack;
 
-    std::string type = bofs::extension(process_set[0]);
+    std::string type = bofs::extension(process_set[i]);
     std::transform(type.begin(), type.end(), type.begin(), ::tolower);
 
+    const ManifestItem &item = units[i].item;
     if(type == ".tif" || type == ".tiff") {
-      // TIFF and multipage TIFF mode
-      image_stack = LoadTiff(process_set[i].string(),
-          nr_channels);
+      // TIFF and multipage TIFF mode, only the pages of the unit are decoded
+      image_stack = LoadTiff(process_set[i].string(), nr_channels,
+                             std::max(item.first_page, 0), item.last_page);
+      if (item.first_page >= 0
+          && (int) image_stack.size() != item.last_page - item.first_page + 1) {
+        LOG(FATAL) << "Page range " << item.first_page << "-"
+                   << item.last_page << " exceeds the pages of " << item.raw;
+      }
     } else {
       // All other image types
       cv::Mat image = cv::imread(process_set[i].string(),
           nr_channels == 1 ? CV_LOAD_IMAGE_GRAYSCALE:CV_LOAD_IMAGE_COLOR);
       image_stack.push_back(image);
+      SelectPages(item, image_stack);
     }
 
     std::vector<std::vector<cv::Mat>> output_stack;
@@ -226,79 +406,51 @@ int Process(caffe_neural::ToolParam &tool_param, CommonSettings &settings) {
 
       cv::Mat image = image_stack[st];
 
-      std::vector<cv::Mat> labels;
-      image_processor.SubmitImage(image, i, labels);
-
-      cv::Mat padimage = image_processor.raw_images()[0];
-
-      int image_size_x = image.cols;
-      int image_size_y = image.rows;
-
+      // Label images are allocated directly in the output format
       std::vector<cv::Mat> outimgs;
-      for(unsigned int k = 0; k < nr_labels; ++k) {
-        cv::Mat outimg(image_size_y, image_size_x, CV_32FC1);
+      for(unsigned int k = 0; k < nr_out_labels; ++k) {
+        cv::Mat outimg(image.rows, image.cols, fp32out?CV_32FC1:CV_8UC1);
         outimgs.push_back(outimg);
       }
 
-      for (int yoff = 0; yoff < (image_size_y - 1) / patch_size + 1; ++yoff) {
-        for (int xoff = 0; xoff < (image_size_x - 1) / patch_size + 1; ++xoff) {
-
-          int xoffp = xoff * patch_size;
-          int yoffp = yoff * patch_size;
-
-          if(xoffp + patch_size > image_size_x) {
-            xoffp = image_size_x - patch_size;
-          }
-
-          if(yoffp + patch_size > image_size_y) {
-            yoffp = image_size_y - patch_size;
-          }
-
-          cv::Rect roi(xoffp, yoffp,
-              padding_size + patch_size - imagecrop,
-              padding_size + patch_size - imagecrop);
-          cv::Mat crop = padimage(roi);
-
-          std::vector<cv::Mat> images;
-          std::vector<int_tp> labels;
-
-          images.push_back(crop);
-          labels.push_back(0);
-
-          boost::dynamic_pointer_cast<caffe::MemoryDataLayer<float>>(
-              (&net)->layers()[0])->AddMatVector(images, labels);
-
-          float loss = 0.0;
-          const vector<Blob<float>*>& result = net.ForwardPrefilled(&loss);
+      int first_tile = 0;
+      if (checkpoint) {
+        if (checkpoint->LoadSlice(st, outimgs)) {
+          LOG(INFO) << "Slice " << st << " restored from checkpoint";
+          output_stack.push_back(outimgs);
+          continue;
+        }
+        first_tile = checkpoint->LoadPartial(st, outimgs);
+        if (first_tile > 0) {
+          LOG(INFO) << "Slice " << st << " resumed at tile " << first_tile;
+        }
+      }
 
-          if(process_param.has_filter_output()) {
-            FilterOutputParam filter_param = process_param.filter_output();
-            if(filter_param.has_output_filters() && filter_param.output_filters() && filter_param.has_output()) {
-              ExportFilters(&net, filter_param.output(), process_set[i], st, yoff, xoff, false);
-            }
-          }
+      std::vector<cv::Mat> labels;
+      MemoryProfiler::Get().SetPhase("preprocess");
+      image_processor.SubmitImage(image, i, labels);
 
-          const float* cpuresult = result[0]->cpu_data();
+      cv::Mat padimage = image_processor.raw_images()[0];
 
-#pragma omp parallel for
-          for (unsigned int k = 0; k < nr_labels; ++k) {
-            for (int y = 0; y < patch_size; ++y) {
-              for (int x = 0; x < patch_size; ++x) {
-                (outimgs[k].at<float>(y + yoffp,
-                        x + xoffp)) =
-                cpuresult[(k * patch_size + y) * patch_size + x];
-              }
-            }
-          }
+      MemoryProfiler::Get().SetPhase("tiles");
+      ProcessTiles(nets, weights, input_buffer, padimage, patch_size,
+                   padding_size, imagecrop, label_offset,
+                   fp32out ? 1.0 : 255.0, outimgs,
+                   [&](int yoff, int xoff, int tiles_done) {
+        filter_exporter.Export(&net, process_set[i], st, yoff, xoff, false);
+        if (checkpoint) {
+          checkpoint->SavePartial(st, tiles_done, outimgs);
+        }
 
-          if (settings.graphic) {
-            for (unsigned int k = 0; k < nr_labels; ++k) {
-              cv::imshow(OCVDBGW, outimgs[k]);
-              cv::waitKey(100);
-            }
+        if (settings.graphic) {
+          for (unsigned int k = 0; k < outimgs.size(); ++k) {
+            cv::imshow(OCVDBGW, outimgs[k]);
+            cv::waitKey(100);
           }
-
         }
+      }, nullptr, first_tile);
+      if (checkpoint) {
+        checkpoint->SaveSlice(st, outimgs);
       }
       output_stack.push_back(outimgs);
     }
@@ -308,14 +460,11 @@ int Process(caffe_neural::ToolParam &tool_param, CommonSettings &settings) {
       format = ".tif";
     }
 
+    MemoryProfiler::Get().SetPhase("save");
+
     bofs::path outp(outpath);
     bofs::create_directories(outp);
 
-    unsigned int nr_out_labels = ((output_param.has_out_all_labels() && output_param.out_all_labels()) || nr_labels > 2)?nr_labels:1;
-
-    // In the two label case, export the second and not the first label output
-    unsigned int label_offset = nr_out_labels==1?1:0;
-
     for(unsigned int k = 0; k < nr_out_labels; ++k) {
       bofs::path outpl = outp;
       if(nr_out_labels > 1) {
@@ -323,24 +472,37 @@ int Process(caffe_neural::ToolParam &tool_param, CommonSettings &settings) {
         bofs::create_directories(outpl);
       }
       bofs::path filep = outpl;
-      filep /= ("/" + process_set[i].stem().string()+format);
+      filep /= ("/" + units[i].name + format);
+      // Written under a temporary name (same extension for imwrite) and
+      // renamed, an interrupted save never leaves a truncated output
+      bofs::path tmpp = outpl;
+      tmpp /= ("/" + units[i].name + ".partial" + format);
 
+      // Already in the output format, see ScatterTile
       std::vector<cv::Mat> saveout(output_stack.size());
       for(unsigned int st = 0; st < output_stack.size();++st) {
-        if(fp32out) {
-          output_stack[st][k+label_offset].convertTo(saveout[st], CV_32FC1, 1.0, 0.0);
-        } else {
-          output_stack[st][k+label_offset].convertTo(saveout[st], CV_8UC1, 255.0, 0.0);
-        }
+        saveout[st] = output_stack[st][k];
       }
 
       if(format == ".tif" || format == ".tiff") {
-        SaveTiff(saveout,filep.string());
+        SaveTiff(saveout,tmpp.string());
       } else {
-        cv::imwrite(filep.string(),saveout[0]);
+        cv::imwrite(tmpp.string(),saveout[0]);
       }
+      if (!bofs::exists(tmpp)) {
+        LOG(FATAL) << "Could not write output: " << filep;
+      }
+      bofs::rename(tmpp, filep);
+    }
+
+    if (checkpoint) {
+      checkpoint->Complete();
+    }
+    if (claims) {
+      claims->Done();
     }
   }
+  MemoryProfiler::Get().SetPhase("done");
   return 0;
 }
 }  // namespace caffe_neural
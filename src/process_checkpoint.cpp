@@ -0,0 +1,144 @@
+/*
+ * process_checkpoint.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "process_checkpoint.hpp"
+#include "filesystem_utils.hpp"
+#include "utils.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+
+namespace caffe_neural {
+
+void SaveMats(std::string file, const std::vector<cv::Mat> &mats) {
+  std::string tmp = file + ".tmp";
+  {
+    std::ofstream out_file(tmp, std::ios::out | std::ios::binary);
+    if (!out_file.is_open()) {
+      LOG(FATAL) << "Could not write checkpoint: " << tmp;
+    }
+    int32_t count = mats.size();
+    out_file.write((const char*) &count, sizeof(count));
+    for (unsigned int i = 0; i < mats.size(); ++i) {
+      cv::Mat mat = mats[i].isContinuous() ? mats[i] : mats[i].clone();
+      int32_t header[3] = { mat.rows, mat.cols, mat.type() };
+      out_file.write((const char*) header, sizeof(header));
+      out_file.write((const char*) mat.ptr(), mat.total() * mat.elemSize());
+    }
+    out_file.flush();
+    if (!out_file.good()) {
+      LOG(FATAL) << "Could not write checkpoint: " << tmp;
+    }
+  }
+  std::rename(tmp.c_str(), file.c_str());
+}
+
+bool LoadMats(std::string file, std::vector<cv::Mat> &mats) {
+  std::ifstream in_file(file, std::ios::in | std::ios::binary);
+  if (!in_file.is_open()) {
+    return false;
+  }
+  int32_t count = 0;
+  in_file.read((char*) &count, sizeof(count));
+  if (!in_file.good() || count != (int32_t) mats.size()) {
+    return false;
+  }
+  for (int i = 0; i < count; ++i) {
+    int32_t header[3];
+    in_file.read((char*) header, sizeof(header));
+    cv::Mat &mat = mats[i];
+    if (!in_file.good() || header[0] != mat.rows || header[1] != mat.cols
+        || header[2] != mat.type() || !mat.isContinuous()) {
+      return false;
+    }
+    in_file.read((char*) mat.ptr(), mat.total() * mat.elemSize());
+    if (!in_file.good()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+ProcessCheckpoint::ProcessCheckpoint(std::string folder, double interval)
+    : folder_(folder),
+      interval_(interval),
+      last_save_(std::chrono::steady_clock::now()) {
+}
+
+bool ProcessCheckpoint::LoadSlice(int slice, std::vector<cv::Mat> &outimgs) {
+  return LoadMats(folder_ + "/slice_" + ZeroPadNumber(slice, 4) + ".mat",
+                  outimgs);
+}
+
+int ProcessCheckpoint::LoadPartial(int slice, std::vector<cv::Mat> &outimgs) {
+  std::ifstream in_file(folder_ + "/partial.txt");
+  int partial_slice = -1;
+  int tiles_done = 0;
+  if (!(in_file >> partial_slice >> tiles_done) || partial_slice != slice) {
+    return 0;
+  }
+  if (!LoadMats(folder_ + "/partial.mat", outimgs)) {
+    LOG(WARNING) << "Invalid partial checkpoint in " << folder_;
+    return 0;
+  }
+  return tiles_done;
+}
+
+void ProcessCheckpoint::SaveSlice(int slice,
+                                  const std::vector<cv::Mat> &outimgs) {
+  bofs::create_directories(folder_);
+  SaveMats(folder_ + "/slice_" + ZeroPadNumber(slice, 4) + ".mat", outimgs);
+  // The partial checkpoint of this slice is superseded
+  bofs::remove(folder_ + "/partial.txt");
+  bofs::remove(folder_ + "/partial.mat");
+  last_save_ = std::chrono::steady_clock::now();
+}
+
+void ProcessCheckpoint::SavePartial(int slice, int tiles_done,
+                                    const std::vector<cv::Mat> &outimgs) {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (std::chrono::duration<double>(now - last_save_).count() < interval_) {
+    return;
+  }
+  bofs::create_directories(folder_);
+  // Data first: a partial.txt always refers to a complete partial.mat
+  bofs::remove(folder_ + "/partial.txt");
+  SaveMats(folder_ + "/partial.mat", outimgs);
+  {
+    std::ofstream out_file(folder_ + "/partial.txt.tmp");
+    out_file << slice << " " << tiles_done << std::endl;
+  }
+  std::rename((folder_ + "/partial.txt.tmp").c_str(),
+              (folder_ + "/partial.txt").c_str());
+  last_save_ = now;
+  LOG(INFO) << "Checkpoint: slice " << slice << ", " << tiles_done
+            << " tiles";
+}
+
+bool ProcessCheckpoint::exists() {
+  return bofs::exists(folder_);
+}
+
+void ProcessCheckpoint::Complete() {
+  bofs::remove_all(folder_);
+  bofs::create_directories(bofs::path(folder_).parent_path());
+  {
+    std::ofstream out_file(folder_ + ".done.tmp");
+    out_file << "done" << std::endl;
+  }
+  std::rename((folder_ + ".done.tmp").c_str(), (folder_ + ".done").c_str());
+}
+
+bool ProcessCheckpoint::complete() {
+  return bofs::exists(folder_ + ".done");
+}
+
+void ProcessCheckpoint::Clear() {
+  bofs::remove_all(folder_);
+  bofs::remove(folder_ + ".done");
+}
+
+}  // namespace caffe_neural
@@ -0,0 +1,218 @@
+/*
+ * roofline.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "roofline.hpp"
+#include <omp.h>
+#include <algorithm>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PEAK_X86
+#endif
+
+namespace caffe_neural {
+
+// Independent accumulator chains per thread, enough to hide FMA latency
+#define PEAK_CHAINS 128
+// Vector accumulators of the x86 kernels (latency x FMA ports, in registers)
+#define PEAK_VECTORS 12
+#define PEAK_ITERATIONS (1L << 22)
+// Stream triad elements per array
+#define PEAK_STREAM_SIZE (1L << 24)
+#define PEAK_REPEAT 5
+
+// Multiply-add chains of one thread, returns the flops done. The build
+// flags (no -march) only give SSE2 mul + add, so the x86 kernels are
+// compiled for AVX2/FMA and AVX-512 and picked at runtime.
+static double FmaKernelGeneric(volatile float &sink) {
+  float acc[PEAK_CHAINS];
+  for (int c = 0; c < PEAK_CHAINS; ++c) {
+    acc[c] = 1.0f + c * 1e-3f;
+  }
+  float mul = 0.9999999f;
+  float add = 1e-7f;
+  for (long i = 0; i < PEAK_ITERATIONS; ++i) {
+#pragma omp simd
+    for (int c = 0; c < PEAK_CHAINS; ++c) {
+      acc[c] = acc[c] * mul + add;
+    }
+  }
+  float sum = 0;
+  for (int c = 0; c < PEAK_CHAINS; ++c) {
+    sum += acc[c];
+  }
+  sink = sum;
+  return 2.0 * PEAK_CHAINS * PEAK_ITERATIONS;
+}
+
+#ifdef PEAK_X86
+__attribute__((target("avx2,fma")))
+static double FmaKernelAvx2(volatile float &sink) {
+  __m256 acc[PEAK_VECTORS];
+  for (int c = 0; c < PEAK_VECTORS; ++c) {
+    acc[c] = _mm256_set1_ps(1.0f + c * 1e-3f);
+  }
+  __m256 mul = _mm256_set1_ps(0.9999999f);
+  __m256 add = _mm256_set1_ps(1e-7f);
+  for (long i = 0; i < PEAK_ITERATIONS; ++i) {
+    for (int c = 0; c < PEAK_VECTORS; ++c) {
+      acc[c] = _mm256_fmadd_ps(acc[c], mul, add);
+    }
+  }
+  float sum[8];
+  for (int c = 1; c < PEAK_VECTORS; ++c) {
+    acc[0] = _mm256_add_ps(acc[0], acc[c]);
+  }
+  _mm256_storeu_ps(sum, acc[0]);
+  sink = sum[0];
+  return 2.0 * 8 * PEAK_VECTORS * PEAK_ITERATIONS;
+}
+
+__attribute__((target("avx512f")))
+static double FmaKernelAvx512(volatile float &sink) {
+  __m512 acc[PEAK_VECTORS];
+  for (int c = 0; c < PEAK_VECTORS; ++c) {
+    acc[c] = _mm512_set1_ps(1.0f + c * 1e-3f);
+  }
+  __m512 mul = _mm512_set1_ps(0.9999999f);
+  __m512 add = _mm512_set1_ps(1e-7f);
+  for (long i = 0; i < PEAK_ITERATIONS; ++i) {
+    for (int c = 0; c < PEAK_VECTORS; ++c) {
+      acc[c] = _mm512_fmadd_ps(acc[c], mul, add);
+    }
+  }
+  for (int c = 1; c < PEAK_VECTORS; ++c) {
+    acc[0] = _mm512_add_ps(acc[0], acc[c]);
+  }
+  sink = _mm512_reduce_add_ps(acc[0]);
+  return 2.0 * 16 * PEAK_VECTORS * PEAK_ITERATIONS;
+}
+#endif
+
+static double MeasureFlops() {
+  double (*kernel)(volatile float&) = FmaKernelGeneric;
+  const char* kernel_name = "generic";
+#ifdef PEAK_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    kernel = FmaKernelAvx512;
+    kernel_name = "avx512";
+  } else if (__builtin_cpu_supports("avx2")
+      && __builtin_cpu_supports("fma")) {
+    kernel = FmaKernelAvx2;
+    kernel_name = "avx2/fma";
+  }
+#endif
+  LOG(INFO) << "Peak FLOP/s kernel: " << kernel_name;
+
+  double best = 0;
+  volatile float sink = 0;
+  for (int rep = 0; rep < PEAK_REPEAT; ++rep) {
+    double flops = 0;
+    std::chrono::time_point<std::chrono::high_resolution_clock> t_start =
+        std::chrono::high_resolution_clock::now();
+#pragma omp parallel reduction(+:flops)
+    flops += kernel(sink);
+    std::chrono::time_point<std::chrono::high_resolution_clock> t_end =
+        std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration<double>(t_end - t_start).count();
+    best = std::max(best, flops / seconds / 1e9);
+  }
+  (void) sink;
+  return best;
+}
+
+static double MeasureBandwidth() {
+  std::vector<float> a(PEAK_STREAM_SIZE);
+  std::vector<float> b(PEAK_STREAM_SIZE);
+  std::vector<float> c(PEAK_STREAM_SIZE);
+
+  // First touch by the threads that use the memory
+#pragma omp parallel for
+  for (long i = 0; i < PEAK_STREAM_SIZE; ++i) {
+    a[i] = 0.0f;
+    b[i] = 1.0f;
+    c[i] = 2.0f;
+  }
+
+  double best = 0;
+  float scalar = 3.0f;
+  for (int rep = 0; rep < PEAK_REPEAT; ++rep) {
+    std::chrono::time_point<std::chrono::high_resolution_clock> t_start =
+        std::chrono::high_resolution_clock::now();
+#pragma omp parallel for simd
+    for (long i = 0; i < PEAK_STREAM_SIZE; ++i) {
+      a[i] = b[i] + scalar * c[i];
+    }
+    std::chrono::time_point<std::chrono::high_resolution_clock> t_end =
+        std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration<double>(t_end - t_start).count();
+    double bytes = 3.0 * sizeof(float) * PEAK_STREAM_SIZE;
+    best = std::max(best, bytes / seconds / 1e9);
+  }
+  return best;
+}
+
+MachinePeak MeasureMachinePeak() {
+  MachinePeak peak;
+  peak.gflops = MeasureFlops();
+  peak.bandwidth = MeasureBandwidth();
+  LOG(INFO) << "Machine peak: " << peak.gflops << " GFLOP/s, "
+            << peak.bandwidth << " GB/s";
+  if (Caffe::mode() == Caffe::GPU) {
+    LOG(INFO) << "Roofline uses the host peak, device layers are compared "
+              << "against the CPU";
+  }
+  return peak;
+}
+
+static double BlobBytes(const vector<Blob<float>*> &blobs) {
+  double bytes = 0;
+  for (unsigned int i = 0; i < blobs.size(); ++i) {
+    bytes += (double) blobs[i]->count() * sizeof(float);
+  }
+  return bytes;
+}
+
+static double ParamBytes(Net<float> &net, int layer) {
+  double bytes = 0;
+  vector<shared_ptr<Blob<float>>> &params = net.layers()[layer]->blobs();
+  for (unsigned int i = 0; i < params.size(); ++i) {
+    bytes += (double) params[i]->count() * sizeof(float);
+  }
+  return bytes;
+}
+
+double LayerForwardBytes(Net<float> &net, int layer) {
+  return BlobBytes(net.bottom_vecs()[layer]) + BlobBytes(net.top_vecs()[layer])
+      + ParamBytes(net, layer);
+}
+
+double LayerBackwardBytes(Net<float> &net, int layer) {
+  return 2.0 * BlobBytes(net.bottom_vecs()[layer])
+      + BlobBytes(net.top_vecs()[layer]) + 2.0 * ParamBytes(net, layer);
+}
+
+void WriteRoofline(std::ostream &out, double flops, double bytes,
+                   double time_ms, const MachinePeak &peak) {
+  double seconds = time_ms / 1e3;
+  double gflops = seconds > 0 ? flops / seconds / 1e9 : 0;
+  double bandwidth = seconds > 0 ? bytes / seconds / 1e9 : 0;
+  double intensity = bytes > 0 ? flops / bytes : 0;
+  double ridge = peak.gflops / peak.bandwidth;
+  double attainable = std::min(peak.gflops, intensity * peak.bandwidth);
+
+  out << ";" << gflops << ";" << bytes << ";" << bandwidth << ";"
+      << intensity << ";" << (intensity < ridge ? "memory" : "compute") << ";";
+  if (flops > 0 && attainable > 0) {
+    out << gflops / attainable;
+  } else {
+    // No FLOP count (data movement layers): share of the peak bandwidth
+    out << bandwidth / peak.bandwidth;
+  }
+}
+
+}  // namespace caffe_neural
@@ -6,12 +6,15 @@
  */
 
 #include "tiffio_wrapper.hpp"
+#include "trace.hpp"
 #include <tiffio.h>
+#include <algorithm>
 #include <iostream>
 
 namespace caffe_neural {
 
 void SaveTiff(std::vector<cv::Mat> image_stack, std::string file) {
+  TraceScope trace("SaveTiff");
 
   const char* filec = file.c_str();
 
@@ -85,7 +88,19 @@ void SaveTiff(std::vector<cv::Mat> image_stack, std::string file) {
   TIFFClose(tif);
 }
 
-std::vector<cv::Mat> LoadTiff(std::string file, int nr_channels) {
+int CountTiffPages(std::string file) {
+  TIFF* tif = TIFFOpen(file.c_str(), "r");
+  if (!tif) {
+    return 0;
+  }
+  int pages = TIFFNumberOfDirectories(tif);
+  TIFFClose(tif);
+  return pages;
+}
+
+std::vector<cv::Mat> LoadTiff(std::string file, int nr_channels,
+                              int first_page, int last_page) {
+  TraceScope trace("LoadTiff");
 
   std::vector<cv::Mat> image_stack;
 
@@ -106,11 +121,13 @@ std::vector<cv::Mat> LoadTiff(std::string file, int nr_channels) {
     uint32* raster = (uint32 *) _TIFFmalloc(
         imagewidth * imageheight * sizeof(uint32));
 
-    do {
-      ++dirs;
-    } while (TIFFReadDirectory(tif));
+    // Directory headers only, the pages outside the range are not decoded
+    dirs = TIFFNumberOfDirectories(tif);
+    if (last_page < 0 || last_page >= dirs) {
+      last_page = dirs - 1;
+    }
 
-    for (int n = 0; n < dirs; ++n) {
+    for (int n = std::max(first_page, 0); n <= last_page; ++n) {
       TIFFSetDirectory(tif, n);
 
       cv::Mat image(imageheight, imagewidth, CV_8UC(nr_channels));
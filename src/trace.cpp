@@ -0,0 +1,177 @@
+/*
+ * trace.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "trace.hpp"
+#include <glog/logging.h>
+#include <cstdio>
+
+namespace caffe_neural {
+
+// Events per thread chunk (24 bytes each)
+#define TRACE_CHUNK 16384
+
+bool Tracer::enabled_ = false;
+
+static thread_local TraceBuffer* thread_buffer = nullptr;
+
+static void WriteJsonString(std::ostream &out, const char* str) {
+  out << '"';
+  for (const char* c = str; *c != '\0'; ++c) {
+    switch (*c) {
+      case '"':
+        out << "\\\"";
+        break;
+      case '\\':
+        out << "\\\\";
+        break;
+      case '\n':
+        out << "\\n";
+        break;
+      case '\t':
+        out << "\\t";
+        break;
+      default:
+        if ((unsigned char) *c < 0x20) {
+          char escaped[8];
+          snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char) *c);
+          out << escaped;
+        } else {
+          out << *c;
+        }
+    }
+  }
+  out << '"';
+}
+
+Tracer::Tracer()
+    : start_(std::chrono::steady_clock::now()),
+      count_(0),
+      stop_(false) {
+}
+
+Tracer& Tracer::Get() {
+  static Tracer tracer;
+  return tracer;
+}
+
+void Tracer::Start(std::string file) {
+  file_ = file;
+  out_file_.open(file_, std::ios::out);
+  if (!out_file_.is_open()) {
+    LOG(ERROR) << "Could not write trace: " << file_;
+    return;
+  }
+  out_file_ << "[" << std::endl;
+  count_ = 0;
+  stop_ = false;
+  writer_ = std::thread(&Tracer::WriterLoop, this);
+  start_ = std::chrono::steady_clock::now();
+  enabled_ = true;
+}
+
+const char* Tracer::Intern(std::string name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return names_.insert(name).first->c_str();
+}
+
+TraceBuffer* Tracer::buffer() {
+  if (thread_buffer == nullptr) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffers_.push_back(std::unique_ptr<TraceBuffer>(new TraceBuffer()));
+    thread_buffer = buffers_.back().get();
+    thread_buffer->tid = buffers_.size() - 1;
+    thread_buffer->events.reserve(TRACE_CHUNK);
+  }
+  return thread_buffer;
+}
+
+void Tracer::Record(const char* name, char phase) {
+  TraceEvent event;
+  event.name = name;
+  event.phase = phase;
+  event.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start_).count();
+  TraceBuffer* thread_events = buffer();
+  thread_events->events.push_back(event);
+  if (thread_events->events.size() >= TRACE_CHUNK) {
+    Flush(thread_events);
+  }
+}
+
+void Tracer::Flush(TraceBuffer* buffer) {
+  std::vector<TraceEvent> next;
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    full_.push_back(TraceChunk { buffer->tid, std::move(buffer->events) });
+    if (free_.size() > 0) {
+      next = std::move(free_.back());
+      free_.pop_back();
+    }
+  }
+  queue_cv_.notify_one();
+  // Recycled chunks keep their capacity, no reallocation while recording
+  next.clear();
+  next.reserve(TRACE_CHUNK);
+  buffer->events = std::move(next);
+}
+
+void Tracer::WriterLoop() {
+  std::unique_lock<std::mutex> lock(queue_mutex_);
+  while (true) {
+    queue_cv_.wait(lock, [this] {return stop_ || full_.size() > 0;});
+    while (full_.size() > 0) {
+      TraceChunk chunk = std::move(full_.front());
+      full_.pop_front();
+      lock.unlock();
+      WriteEvents(chunk.tid, chunk.events);
+      out_file_.flush();
+      lock.lock();
+      free_.push_back(std::move(chunk.events));
+    }
+    if (stop_) {
+      return;
+    }
+  }
+}
+
+void Tracer::WriteEvents(int tid, const std::vector<TraceEvent> &events) {
+  for (unsigned int i = 0; i < events.size(); ++i) {
+    const TraceEvent &event = events[i];
+    // Timestamps in microseconds
+    out_file_ << (count_++ > 0 ? ",\n" : "") << "{\"name\":";
+    WriteJsonString(out_file_, event.name);
+    out_file_ << ",\"ph\":\"" << event.phase << "\",\"ts\":"
+              << event.time / 1000 << "." << (event.time % 1000) / 100
+              << ",\"pid\":0,\"tid\":" << tid << "}";
+  }
+}
+
+void Tracer::Close() {
+  if (!enabled_) {
+    return;
+  }
+  enabled_ = false;
+
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    stop_ = true;
+  }
+  queue_cv_.notify_one();
+  writer_.join();
+
+  // Partially filled chunks of all threads
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (unsigned int b = 0; b < buffers_.size(); ++b) {
+    WriteEvents(buffers_[b]->tid, buffers_[b]->events);
+    buffers_[b]->events.clear();
+  }
+  out_file_ << std::endl << "]" << std::endl;
+  out_file_.close();
+
+  LOG(INFO) << "Trace written (" << count_ << " events): " << file_;
+}
+
+}  // namespace caffe_neural
@@ -8,42 +8,37 @@
 #include "process.hpp"
 #include "train.hpp"
 #include "filesystem_utils.hpp"
+#include "manifest.hpp"
 #include "utils.hpp"
-#include "caffe/layers/memory_data_layer.hpp"
+#include "memory_data_buffer.hpp"
+#include "validation.hpp"
+#include "async_snapshot.hpp"
+#include "filter_exporter.hpp"
+#include "pipeline_stats.hpp"
+#include "trace.hpp"
+#include "memory_profiler.hpp"
+#include <cfloat>
+#include <chrono>
+#include <cmath>
 
 
 namespace caffe_neural {
 
-typedef std::map<std::string, int> pmap;
-
-void preload_process_images(TrainImageProcessor& image_processor, InputParam& input_param, pmap extra_param) {
- //unpack params
-  unsigned int nr_channels = 0;
-  unsigned int nr_labels = 0;
-  if (extra_param.count("nr_channels") != 0)
-    nr_channels = static_cast<unsigned int>(extra_param.find("nr_channels")->second);
-  else
-    LOG(INFO) << "Assume number of channels = 0";
-  if (extra_param.count("nr_labels") != 0)
-    nr_labels = static_cast<unsigned int>(extra_param.find("nr_labels")->second);
-  else
-    LOG(INFO) << "Assume number of labels = 0";
-
-  if ( input_param.has_preprocessor() )
-    image_processor.SetUpParams(input_param, extra_param);
-
-  if(!(input_param.has_raw_images() && input_param.has_label_images())) {
+void LoadTrainingImages(InputParam& input_param, unsigned int nr_channels,
+                        unsigned int nr_labels,
+                        std::vector<cv::Mat>& raw_images,
+                        std::vector<std::vector<cv::Mat>>& label_images,
+                        std::vector<float>* image_weights) {
+  if(!input_param.has_manifest() && !(input_param.has_raw_images() && input_param.has_label_images())) {
     LOG(FATAL) << "Raw images or label images folder missing.";
   }
 
-  std::set<std::string> filetypes = CreateImageTypesSet();
-
-  int error;
-  std::vector<std::vector<bofs::path>> training_set = LoadTrainingSetItems(filetypes, input_param.raw_images(),input_param.label_images(),&error);
-  unsigned int ijsum = 0;
-  // Preload and preprocess all images
+  std::vector<ManifestItem> training_set = LoadInputItems(input_param, true);
+  // Load all images
   for (unsigned int i = 0; i < training_set.size(); ++i) {
-    std::vector<bofs::path> training_item = training_set[i];
+    std::vector<bofs::path> training_item(1, training_set[i].raw);
+    training_item.insert(training_item.end(), training_set[i].labels.begin(),
+                         training_set[i].labels.end());
 
     std::vector<cv::Mat> raw_stack;
     std::vector<std::vector<cv::Mat>> labels_stack(training_item.size() - 1);
@@ -60,11 +55,13 @@ void preload_process_images(TrainImageProcessor& image_processor, InputParam& in
           CV_LOAD_IMAGE_COLOR);
       raw_stack.push_back(raw_image);
     }
+    SelectPages(training_set[i], raw_stack);
     for(unsigned int k = 0; k < training_item.size() - 1; ++k) {
       std::string type = bofs::extension(training_item[k+1]);
       std::transform(type.begin(), type.end(), type.begin(), ::tolower);
       if(type == ".tif" || type == ".tiff") {
         std::vector<cv::Mat> label_stack = LoadTiff(training_item[k+1].string(), 1);
+        SelectPages(training_set[i], label_stack);
         labels_stack[k] = label_stack;
       }
       else {
@@ -75,23 +72,106 @@ void preload_process_images(TrainImageProcessor& image_processor, InputParam& in
       }
     }
     for (unsigned int j = 0; j < raw_stack.size(); ++j) {
-      std::vector<cv::Mat> label_images;
+      std::vector<cv::Mat> label_item;
       for(unsigned int k = 0; k < labels_stack.size(); ++k) {
-        label_images.push_back(labels_stack[k][j]);
+        label_item.push_back(labels_stack[k][j]);
       }
 
-      if(label_images.size() > 1 && nr_labels != 2 && label_images.size() < nr_labels) {
+      if(label_item.size() > 1 && nr_labels != 2 && label_item.size() < nr_labels) {
         // Generate complement label
-        cv::Mat clabel(label_images[0].rows, label_images[0].cols, CV_8UC(1), 255.0);
-        for(unsigned int k = 0; k < label_images.size(); ++k) {
-          cv::subtract(clabel,label_images[k],clabel);
+        cv::Mat clabel(label_item[0].rows, label_item[0].cols, CV_8UC(1), 255.0);
+        for(unsigned int k = 0; k < label_item.size(); ++k) {
+          cv::subtract(clabel,label_item[k],clabel);
         }
-        label_images.push_back(clabel);
+        label_item.push_back(clabel);
+      }
+      raw_images.push_back(raw_stack[j]);
+      label_images.push_back(label_item);
+      if (image_weights != nullptr) {
+        image_weights->push_back(training_set[i].weight);
       }
-      image_processor.SubmitImage(raw_stack[j], ijsum, label_images);
-      ++ijsum;
     }
   }
+}
+
+// Training loss per patch of the last batch for hard example mining: mean
+// cross entropy of the class probabilities over the unmasked label pixels.
+// Without the probability blob, all patches get the batch loss (the sampler
+// then can not distinguish the patches of one batch).
+static void PatchLosses(Net<float> &net, const PrepHardMiningParam &param,
+                        MemoryDataBuffer &label_buffer,
+                        std::vector<double> &losses) {
+  if (net.has_blob(param.prob_blob())) {
+    const boost::shared_ptr<Blob<float>> prob = net.blob_by_name(
+        param.prob_blob());
+    int labels = prob->channels();
+    int pixels = prob->height() * prob->width();
+    CHECK_EQ(prob->num(), label_buffer.num());
+    CHECK_EQ(pixels, label_buffer.height() * label_buffer.width())
+        << "Blob " << param.prob_blob() << " does not match the labels.";
+    const float* prob_data = prob->cpu_data();
+#pragma omp parallel for
+    for (int n = 0; n < prob->num(); ++n) {
+      const float* label = label_buffer.submitted(n);
+      const float* sample = prob_data + (long) n * labels * pixels;
+      double loss = 0.0;
+      long count = 0;
+      for (int p = 0; p < pixels; ++p) {
+        int l = (int) label[p];
+        if (l < 0 || l >= labels) {
+          continue;
+        }
+        loss -= std::log(std::max(sample[(long) l * pixels + p], FLT_MIN));
+        ++count;
+      }
+      losses[n] = count > 0 ? loss / count : 0.0;
+    }
+    return;
+  }
+
+  if (!net.has_blob(param.loss_blob())) {
+    LOG(FATAL) << "Hard example mining: training net has neither blob "
+               << param.prob_blob() << " nor " << param.loss_blob();
+  }
+  const boost::shared_ptr<Blob<float>> loss = net.blob_by_name(
+      param.loss_blob());
+  CHECK_EQ(loss->count(), 1) << "Blob " << param.loss_blob()
+                             << " is not a scalar loss.";
+  std::fill(losses.begin(), losses.end(), loss->cpu_data()[0]);
+}
+
+void preload_process_images(TrainImageProcessor& image_processor, InputParam& input_param, pmap extra_param) {
+  MemoryPhase phase("preload");
+ //unpack params
+  unsigned int nr_channels = 0;
+  unsigned int nr_labels = 0;
+  if (extra_param.count("nr_channels") != 0)
+    nr_channels = static_cast<unsigned int>(extra_param.find("nr_channels")->second);
+  else
+    LOG(INFO) << "Assume number of channels = 0";
+  if (extra_param.count("nr_labels") != 0)
+    nr_labels = static_cast<unsigned int>(extra_param.find("nr_labels")->second);
+  else
+    LOG(INFO) << "Assume number of labels = 0";
+
+  if ( input_param.has_preprocessor() )
+    image_processor.SetUpParams(input_param, extra_param);
+
+  std::vector<cv::Mat> raw_images;
+  std::vector<std::vector<cv::Mat>> label_images;
+  std::vector<float> image_weights;
+  LoadTrainingImages(input_param, nr_channels, nr_labels, raw_images,
+                     label_images, &image_weights);
+
+  for (unsigned int j = 0; j < raw_images.size(); ++j) {
+    image_processor.SubmitImage(raw_images[j], j, label_images[j]);
+  }
+
+  // Manifest weights, uniform sampling otherwise
+  if (std::any_of(image_weights.begin(), image_weights.end(),
+                  [](float weight) { return weight != 1.0; })) {
+    image_processor.SetImageWeights(image_weights);
+  }
 
   image_processor.Init();
 
@@ -126,9 +206,35 @@ int Train(ToolParam &tool_param, CommonSettings &settings) {
 
   int test_interval = solver_param.has_test_interval()?solver_param.test_interval():-1;
 
+  // Take over snapshotting from the solver, written in the background
+  int snapshot_interval = 0;
+  std::unique_ptr<AsyncSnapshotWriter> snapshot_writer;
+  if (train_param.async_snapshot() && solver_param.snapshot() > 0
+      && solver_param.snapshot_format()
+          == caffe::SolverParameter_SnapshotFormat_BINARYPROTO) {
+    snapshot_interval = solver_param.snapshot();
+    snapshot_writer.reset(
+        new AsyncSnapshotWriter(solver_param.snapshot_prefix()));
+    solver_param.set_snapshot(0);
+  }
+
+  FilterExporter filter_exporter(train_param.filter_output());
+
   shared_ptr<caffe::Solver<float> >
         solver(caffe::SolverRegistry<float>::CreateSolver(solver_param));
 
+  // Stage timings of the training pipeline
+  PipelineStats stats;
+  StatsParam stats_param = train_param.stats();
+  if (stats_param.has_output()) {
+    stats.Open(stats_param.output(), stats_param.format());
+  }
+  int stats_interval = std::max(stats_param.interval(), 1);
+  int stage_iteration = stats.AddStage("iteration");
+  int stage_draw = stats.AddStage("draw_patch");
+  SolverStageTimer solver_timer(&stats);
+  solver->add_callback(&solver_timer);
+
   if(train_param.has_solverstate()) {
     // Continue from previous solverstate
     const char* solver_state_c = train_param.solverstate().c_str();
@@ -158,29 +264,78 @@ int Train(ToolParam &tool_param, CommonSettings &settings) {
   extra_param["nr_labels"] = nr_labels;
   extra_param["padding_size"] = padding_size;
   preload_process_images(image_processor, input_param, extra_param);
+  image_processor.SetPipelineStats(&stats);
+
+  // Validation with the test set on the current training weights
+  int validation_interval = -1;
+  if (train_param.has_validation()) {
+    ValidationParam validation_param = train_param.validation();
+    validation_interval = validation_param.has_interval() ?
+        validation_param.interval() : test_interval;
+  }
 
-  if (test_interval != -1) {
+  if (test_interval != -1 || validation_interval > 0) {
     InputParam test_input_param = tool_param.process(settings.param_index).input();
     extra_param["padding_size"] = test_input_param.padding_size();
 
     preload_process_images(test_img_processor, test_input_param, extra_param);
   } 
 
+  std::unique_ptr<Net<float>> validation_net;
+  std::unique_ptr<MemoryDataBuffer> validation_buffer;
+  std::ofstream validation_file;
+  if (validation_interval > 0) {
+    ProcessParam validation_process_param = tool_param.process(settings.param_index);
+    validation_net.reset(new Net<float>(validation_process_param.process_net(),
+                                        caffe::TEST, Caffe::GetDefaultDevice()));
+    // Shares (not copies) the weights with the training net
+    validation_net->ShareTrainedLayersWith(train_net.get());
+    validation_buffer.reset(new MemoryDataBuffer(validation_net->layers()[0]));
+    if (train_param.validation().has_output()) {
+      validation_file.open(train_param.validation().output(),
+                           std::ios::out | std::ios::app);
+    }
+  }
 
-  std::vector<long> labelcounter(nr_labels + 1);
 
   int train_iters = solver_param.has_max_iter()?solver_param.max_iter():0;
 
+  // Network input storage, filled in place by the image processor
+  MemoryDataBuffer label_buffer(train_net->layers()[0]);
+  MemoryDataBuffer image_buffer(train_net->layers()[1]);
+  std::unique_ptr<MemoryDataBuffer> label_test_buffer;
+  std::unique_ptr<MemoryDataBuffer> image_test_buffer;
+  if (test_interval > -1) {
+    label_test_buffer.reset(new MemoryDataBuffer(test_net->layers()[0]));
+    image_test_buffer.reset(new MemoryDataBuffer(test_net->layers()[1]));
+  }
+
+  std::vector<cv::Mat> patch;
+
+  int stage_submit = stats.AddStage("submit");
+  int stage_step = stats.AddStage("step");
+  int stage_snapshot = stats.AddStage("snapshot");
+  int stage_export = stats.AddStage("filter_export");
+  int stage_validation = stats.AddStage("validation");
+
+  // Patch ids of the batch and their training loss (hard example mining)
+  std::vector<long> patch_ids(image_buffer.num());
+  std::vector<double> patch_losses(image_buffer.num());
+
   // Do the training
+  MemoryProfiler::Get().SetPhase("training");
   for (int i = 0; i < train_iters; ++i) {
-    std::string debug_string;
-    std::vector<cv::Mat> patch;
-    std::vector<cv::Mat> images, images_test;
-    std::vector<cv::Mat> labels, labels_test;
- 
-    patch = image_processor.DrawPatchRandom();
-    images.push_back(patch[0]);
-    labels.push_back(patch[1]);
+    if (i > 0 && i % stats_interval == 0) {
+      stats.Dump(i, (long) i * image_buffer.num());
+    }
+    StageTimer iteration_timer(&stats, stage_iteration);
+
+    for (int n = 0; n < image_buffer.num(); ++n) {
+      StageTimer timer(&stats, stage_draw);
+      patch_ids[n] = image_processor.DrawPatchRandom(image_buffer.sample(n),
+                                                     label_buffer.sample(n),
+                                                     patch);
+    }
 
     //Prepare test images for test stage
     if(test_interval > -1 && i % test_interval == 0) {
@@ -191,8 +346,10 @@ int Train(ToolParam &tool_param, CommonSettings &settings) {
       int padding = test_input_param.padding_size();
       cv::Rect img_roi = cv::Rect(offset / 2, offset / 2, size + padding, size + padding);
       cv::Rect label_roi = cv::Rect(offset / 2, offset / 2, size, size);
-      images_test.push_back(cv::Mat(test_img_processor.raw_images()[0], img_roi).clone());
-      labels_test.push_back(cv::Mat(test_img_processor.label_images()[0], label_roi).clone());
+      image_test_buffer->Write(0,
+          cv::Mat(test_img_processor.raw_images()[0], img_roi));
+      label_test_buffer->Write(0,
+          cv::Mat(test_img_processor.label_images()[0], label_roi));
     }
     
 //    std::cout << "image.size(): " << patch[0].size() << (patch.size() > 2)?(std::cout << " vs. " << patch[2].size() << std::endl):(std::cout << std::endl);
@@ -201,17 +358,15 @@ int Train(ToolParam &tool_param, CommonSettings &settings) {
     
 
     
-    // TODO: Only enable in debug or statistics mode
-    for (int y = 0; y < patch_size; ++y) {
-      for (int x = 0; x < patch_size; ++x) {
-        labelcounter[patch[1].at<float>(y, x) + 1] += 1;
-      }
-    }
-
     if(settings.debug) {
+      // Counted by DrawPatchRandom in the same pass as masking
+      std::vector<long> &labelcounter = image_processor.label_counter();
       for (unsigned int k = 0; k < nr_labels + 1; ++k) {
         std::cout << "Label: " << ((int)k - 1) << ", " << labelcounter[k] << std::endl;
       }
+      std::cout << "Patch pool: " << image_processor.patch_pool().allocations()
+                << " allocations, " << image_processor.patch_pool().requests()
+                << " requests" << std::endl;
     }
 
     if(settings.graphic) {
@@ -242,43 +397,80 @@ int Train(ToolParam &tool_param, CommonSettings &settings) {
       cv::waitKey(10);
     }
     
-    // The labels
-    std::vector<int_tp> lalabels;
-    lalabels.push_back(0);
-    boost::dynamic_pointer_cast<caffe::MemoryDataLayer<float>>(
-        train_net->layers()[0])->AddMatVector(labels, lalabels);
-
-    // The images
-    std::vector<int_tp> imlabels;
-    imlabels.push_back(0);
-    boost::dynamic_pointer_cast<caffe::MemoryDataLayer<float>>(
-        train_net->layers()[1])->AddMatVector(images, imlabels);
+    // Hand the filled buffers to the memory data layers (no copy)
+    {
+      StageTimer timer(&stats, stage_submit);
+      label_buffer.Submit();
+      image_buffer.Submit();
+
+      if(test_interval > -1 && i % test_interval == 0) {
+        label_test_buffer->Submit();
+        image_test_buffer->Submit();
+      }
+    }
 
-    if(test_interval > -1 && i % test_interval == 0) {
-      // The labels
-      boost::dynamic_pointer_cast<caffe::MemoryDataLayer<float>>(
-          test_net->layers()[0])->AddMatVector(labels_test, lalabels);
+    {
+      StageTimer timer(&stats, stage_step);
+      TraceScope trace("Step");
+      solver->Step(1L);
+    }
 
-      // The images
-      boost::dynamic_pointer_cast<caffe::MemoryDataLayer<float>>(
-          test_net->layers()[1])->AddMatVector(images_test, imlabels);
+    if (snapshot_interval > 0 && solver->iter() % snapshot_interval == 0) {
+      StageTimer timer(&stats, stage_snapshot);
+      snapshot_writer->Snapshot(solver.get());
     }
 
-    solver->Step(1L);
-    if (train_param.has_filter_output()) {
-      FilterOutputParam filter_param = train_param.filter_output();
-      if (filter_param.has_output_filters() && filter_param.output_filters() && filter_param.has_output()) {
-        ExportFilters(solver->net().get(), filter_param.output(), bofs::path("train"), 0, 0, 0, true);
-      }
+    // Feeds the hard example sampler
+    if (image_processor.hard_mining()) {
+      PatchLosses(*train_net, input_param.preprocessor().hard_mining(),
+                  label_buffer, patch_losses);
+      image_processor.UpdateLoss(patch_ids, patch_losses);
+    }
+    {
+      StageTimer timer(&stats, stage_export);
+      filter_exporter.Export(solver->net().get(), bofs::path("train"), 0, 0, 0, true);
     }
 
-    if(test_interval > -1 && i % test_interval == 0) {
-      // TODO: Run tests with the testset and testnet
-      // TODO: Apply ISBI and other quality measures (cross, rand, pixel, warp, loss)
-      // TODO: Write out statistics to file
+    if(validation_interval > 0 && (i + 1) % validation_interval == 0) {
+      StageTimer timer(&stats, stage_validation);
+      MemoryPhase phase("validation");
+      InputParam test_input_param = tool_param.process(settings.param_index).input();
+      int imagecrop = 0;
+      if (test_input_param.has_preprocessor()
+          && test_input_param.preprocessor().has_crop()) {
+        imagecrop = test_input_param.preprocessor().crop().imagecrop();
+      }
+
+      std::chrono::time_point<std::chrono::high_resolution_clock> t_start, t_end;
+      t_start = std::chrono::high_resolution_clock::now();
+      ValidationResult result = Validate(
+          *validation_net, *validation_buffer, test_img_processor,
+          test_input_param.patch_size(), test_input_param.padding_size(),
+          imagecrop, test_input_param.labels(),
+          train_param.validation().max_images());
+      t_end = std::chrono::high_resolution_clock::now();
+      double time_ms = (double) ((t_end - t_start).count()) / ((double) 1e6);
+
+      LOG(INFO) << "Validation (" << result.images << " images), pixel error: "
+          << result.pixel_error << ", rand error: " << result.rand_error
+          << ", warping error: " << result.warping_error << ", "
+          << time_ms << " ms";
+
+      if (validation_file.is_open()) {
+        validation_file << (i + 1) << ";" << std::setprecision(10)
+            << result.pixel_error << ";" << result.rand_error << ";"
+            << result.warping_error << ";" << time_ms << std::endl;
+      }
     }
   }
 
+  if (snapshot_writer) {
+    snapshot_writer->Wait();
+  }
+  filter_exporter.Wait();
+  stats.Dump(train_iters, (long) train_iters * image_buffer.num());
+
+  MemoryProfiler::Get().SetPhase("done");
   LOG(INFO) << "Training done!";
 
   return 0;
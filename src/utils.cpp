@@ -6,7 +6,10 @@
  */
 
 #include <sys/time.h>
+#include <sys/resource.h>
 #include "utils.hpp"
+#include <cstdlib>
+#include <fstream>
 #include <random>
 #include <sstream>
 
@@ -27,63 +30,36 @@ std::string ZeroPadNumber(int number, int total_size) {
   return ret;
 }
 
-std::function<unsigned int()> GetRandomSelector(unsigned int set_size) {
+uint64_t GetTimeSeed() {
   struct timeval start_time;
   gettimeofday(&start_time, NULL);
   std::seed_seq seq { start_time.tv_sec, start_time.tv_usec };
-  std::mt19937_64 generator(seq);
-  std::uniform_int_distribution<unsigned int> distribution(0, set_size - 1);
-  std::function<unsigned int()> selector = std::bind(distribution, generator);
-  return selector;
+  uint32_t seed[2];
+  seq.generate(seed, seed + 2);
+  return ((uint64_t) seed[1] << 32) | seed[0];
 }
 
-std::function<unsigned int()> GetRandomOffset(unsigned int min, unsigned int max) {
-  struct timeval start_time;
-  gettimeofday(&start_time, NULL);
-  std::seed_seq seq { start_time.tv_sec, start_time.tv_usec };
-  std::mt19937_64 generator(seq);
-  std::uniform_int_distribution<unsigned int> distribution(min, max);
-  std::function<unsigned int()> offset = std::bind(distribution, generator);
-  return offset;
+long GetPeakRSS() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
 }
 
-template<typename Dtype>
-std::function<Dtype()> GetRandomUniform(Dtype min, Dtype max) {
-  struct timeval start_time;
-  gettimeofday(&start_time, NULL);
-  std::seed_seq seq { start_time.tv_sec, start_time.tv_usec };
-  std::mt19937_64 generator(seq);
-  std::uniform_real_distribution<Dtype> distribution(min, max);
-  std::function<Dtype()> uniform = std::bind(distribution, generator);
-  return uniform;
-}
-
-template std::function<float()> GetRandomUniform(float min, float max);
-template std::function<double()> GetRandomUniform(double min, double max);
-
-std::function<int()> GetRandomUniform(int min, int max) {
-  struct timeval start_time;
-  gettimeofday(&start_time, NULL);
-  std::seed_seq seq { start_time.tv_sec, start_time.tv_usec };
-  std::mt19937_64 generator(seq);
-  std::uniform_int_distribution<int> distribution(min, max);
-  std::function<int()> uniform = std::bind(distribution, generator);
-  return uniform;
+bool ResetPeakRSS() {
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5" << std::endl;
+  return clear_refs.good();
 }
 
-template<typename Dtype>
-std::function<Dtype()> GetRandomNormal(Dtype mu, Dtype std) {
-  struct timeval start_time;
-  gettimeofday(&start_time, NULL);
-  std::seed_seq seq { start_time.tv_sec, start_time.tv_usec };
-  std::mt19937_64 generator(seq);
-  std::normal_distribution<Dtype> distribution(mu, std);
-  std::function<Dtype()> normal = std::bind(distribution, generator);
-  return normal;
+long GetWindowPeakRSS() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      return std::atol(line.c_str() + 6);
+    }
+  }
+  return GetPeakRSS();
 }
 
-template std::function<float()> GetRandomNormal(float mu, float std);
-template std::function<double()> GetRandomNormal(double mu, double std);
-
-
 }
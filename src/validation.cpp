@@ -0,0 +1,304 @@
+/*
+ * validation.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "validation.hpp"
+#include "process.hpp"
+#include <unordered_map>
+#include <stdint.h>
+
+namespace caffe_neural {
+
+cv::Mat LabelSegments(const cv::Mat &labels, int* nr_segments) {
+  int rows = labels.rows;
+  int cols = labels.cols;
+  std::vector<int> parent(rows * cols);
+
+  // Union-find with path halving, roots are always the smallest index
+  auto find = [&parent](int i) {
+    while (parent[i] != i) {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  };
+  auto unite = [&parent, &find](int a, int b) {
+    a = find(a);
+    b = find(b);
+    if (a < b) {
+      parent[b] = a;
+    } else if (b < a) {
+      parent[a] = b;
+    }
+  };
+
+  for (int y = 0; y < rows; ++y) {
+    const int* row = labels.ptr<int>(y);
+    const int* up = y > 0 ? labels.ptr<int>(y - 1) : nullptr;
+    for (int x = 0; x < cols; ++x) {
+      int idx = y * cols + x;
+      parent[idx] = idx;
+      if (x > 0 && row[x - 1] == row[x]) {
+        unite(idx, idx - 1);
+      }
+      if (up != nullptr && up[x] == row[x]) {
+        unite(idx, idx - cols);
+      }
+    }
+  }
+
+  cv::Mat segments(rows, cols, CV_32SC1);
+  int* seg = segments.ptr<int>();
+  int count = 0;
+  for (int idx = 0; idx < rows * cols; ++idx) {
+    int root = find(idx);
+    // Roots come first in scan order, so they are numbered before use
+    seg[idx] = root == idx ? count++ : seg[root];
+  }
+
+  (*nr_segments) = count;
+  return segments;
+}
+
+double PixelError(const cv::Mat &prediction, const cv::Mat &truth) {
+  long errors = 0;
+  for (int y = 0; y < truth.rows; ++y) {
+    const int* p = prediction.ptr<int>(y);
+    const int* t = truth.ptr<int>(y);
+    for (int x = 0; x < truth.cols; ++x) {
+      errors += p[x] != t[x];
+    }
+  }
+  return (double) errors / (double) (truth.rows * truth.cols);
+}
+
+double RandError(const cv::Mat &prediction_seg, int nr_prediction_seg,
+                 const cv::Mat &truth_seg, int nr_truth_seg) {
+  std::unordered_map<uint64_t, long> contingency;
+  std::vector<long> prediction_count(nr_prediction_seg);
+  std::vector<long> truth_count(nr_truth_seg);
+
+  for (int y = 0; y < truth_seg.rows; ++y) {
+    const int* p = prediction_seg.ptr<int>(y);
+    const int* t = truth_seg.ptr<int>(y);
+    for (int x = 0; x < truth_seg.cols; ++x) {
+      ++contingency[((uint64_t) t[x] << 32) | (uint32_t) p[x]];
+      ++prediction_count[p[x]];
+      ++truth_count[t[x]];
+    }
+  }
+
+  // Pairs together in both, in the prediction and in the truth
+  double pairs_both = 0;
+  for (auto it = contingency.begin(); it != contingency.end(); ++it) {
+    pairs_both += 0.5 * (double) it->second * (double) (it->second - 1);
+  }
+  double pairs_prediction = 0;
+  for (int i = 0; i < nr_prediction_seg; ++i) {
+    pairs_prediction += 0.5 * (double) prediction_count[i]
+        * (double) (prediction_count[i] - 1);
+  }
+  double pairs_truth = 0;
+  for (int i = 0; i < nr_truth_seg; ++i) {
+    pairs_truth += 0.5 * (double) truth_count[i] * (double) (truth_count[i] - 1);
+  }
+
+  double n = (double) truth_seg.rows * truth_seg.cols;
+  double pairs = 0.5 * n * (n - 1);
+  if (pairs == 0) {
+    return 0.0;
+  }
+  return 1.0
+      - (pairs + 2.0 * pairs_both - pairs_prediction - pairs_truth) / pairs;
+}
+
+// Simple point lookup table over the 8 neighbors (bit i set: foreground),
+// with 8-connected foreground and 4-connected background.
+static std::vector<bool> CreateSimplePointTable() {
+  const int dy[8] = { -1, -1, -1, 0, 1, 1, 1, 0 };
+  const int dx[8] = { -1, 0, 1, 1, 1, 0, -1, -1 };
+  std::vector<bool> table(256);
+
+  for (int mask = 0; mask < 256; ++mask) {
+    // Number of components of neighbors with value fg, optionally only
+    // counting those touching a 4-neighbor of the center
+    auto components = [&](bool fg, bool four) {
+      int visited = 0;
+      int count = 0;
+      for (int s = 0; s < 8; ++s) {
+        if ((((mask >> s) & 1) == fg) && !((visited >> s) & 1)) {
+          int stack[8];
+          int top = 0;
+          bool touches = false;
+          stack[top++] = s;
+          visited |= 1 << s;
+          while (top > 0) {
+            int i = stack[--top];
+            touches |= (dy[i] == 0 || dx[i] == 0);
+            for (int j = 0; j < 8; ++j) {
+              int ady = std::abs(dy[i] - dy[j]);
+              int adx = std::abs(dx[i] - dx[j]);
+              bool adjacent = four ? (ady + adx == 1) : (ady <= 1 && adx <= 1);
+              if (adjacent && (((mask >> j) & 1) == fg)
+                  && !((visited >> j) & 1)) {
+                visited |= 1 << j;
+                stack[top++] = j;
+              }
+            }
+          }
+          count += (!four || touches);
+        }
+      }
+      return count;
+    };
+    table[mask] = components(true, false) == 1 && components(false, true) == 1;
+  }
+  return table;
+}
+
+double WarpingError(const cv::Mat &prediction_fg, const cv::Mat &truth_fg) {
+  static const std::vector<bool> simple = CreateSimplePointTable();
+  const int dy[8] = { -1, -1, -1, 0, 1, 1, 1, 0 };
+  const int dx[8] = { -1, 0, 1, 1, 1, 0, -1, -1 };
+
+  cv::Mat warped = truth_fg.clone();
+  int rows = warped.rows;
+  int cols = warped.cols;
+
+  std::vector<int> mismatches;
+  for (int y = 0; y < rows; ++y) {
+    const uchar* p = prediction_fg.ptr<uchar>(y);
+    const uchar* w = warped.ptr<uchar>(y);
+    for (int x = 0; x < cols; ++x) {
+      if (p[x] != w[x]) {
+        mismatches.push_back(y * cols + x);
+      }
+    }
+  }
+
+  // Flip simple mismatching points until no further flip is possible
+  bool changed = true;
+  while (changed && mismatches.size() > 0) {
+    changed = false;
+    unsigned int kept = 0;
+    for (unsigned int i = 0; i < mismatches.size(); ++i) {
+      int y = mismatches[i] / cols;
+      int x = mismatches[i] % cols;
+      int mask = 0;
+      for (int s = 0; s < 8; ++s) {
+        int ny = y + dy[s];
+        int nx = x + dx[s];
+        // Outside of the image counts as background
+        if (ny >= 0 && ny < rows && nx >= 0 && nx < cols
+            && warped.at<uchar>(ny, nx)) {
+          mask |= 1 << s;
+        }
+      }
+      if (simple[mask]) {
+        warped.at<uchar>(y, x) = prediction_fg.at<uchar>(y, x);
+        changed = true;
+      } else {
+        mismatches[kept++] = mismatches[i];
+      }
+    }
+    mismatches.resize(kept);
+  }
+
+  return (double) mismatches.size() / (double) (rows * cols);
+}
+
+ValidationResult Validate(Net<float> &net, MemoryDataBuffer &input_buffer,
+                          ImageProcessor &processor, int patch_size,
+                          int padding_size, int imagecrop, int nr_labels,
+                          int max_images) {
+  int images = processor.raw_images().size();
+  if (max_images > 0) {
+    images = std::min(images, max_images);
+  }
+
+  std::vector<cv::Mat> predictions(images);
+  std::vector<cv::Mat> truths(images);
+
+  // Inference (sequential on the device)
+  for (int k = 0; k < images; ++k) {
+    cv::Mat &truth_label = processor.label_images()[k];
+
+    std::vector<cv::Mat> outimgs;
+    for (int l = 0; l < nr_labels; ++l) {
+      outimgs.push_back(cv::Mat(truth_label.rows, truth_label.cols, CV_32FC1));
+    }
+    ProcessTiles(net, input_buffer, processor.raw_images()[k], patch_size,
+                 padding_size, imagecrop, 0, 1.0, outimgs);
+
+    // Arg max over the label probabilities
+    cv::Mat prediction(truth_label.rows, truth_label.cols, CV_32SC1);
+    cv::Mat truth(truth_label.rows, truth_label.cols, CV_32SC1);
+    std::vector<float> &label_value = processor.label_value();
+    double min_label, max_label;
+    cv::minMaxLoc(truth_label, &min_label, &max_label);
+    if (min_label < 0 || max_label >= label_value.size()) {
+      LOG(FATAL) << "Label image " << k << " has labels " << min_label
+                 << " to " << max_label << ", only " << label_value.size()
+                 << " label values known";
+    }
+#pragma omp parallel for
+    for (int y = 0; y < truth_label.rows; ++y) {
+      for (int x = 0; x < truth_label.cols; ++x) {
+        int best = 0;
+        for (int l = 1; l < nr_labels; ++l) {
+          if (outimgs[l].at<float>(y, x) > outimgs[best].at<float>(y, x)) {
+            best = l;
+          }
+        }
+        prediction.at<int>(y, x) = best;
+        truth.at<int>(y, x) =
+            (int) label_value[(int) truth_label.at<float>(y, x)];
+      }
+    }
+    predictions[k] = prediction;
+    truths[k] = truth;
+  }
+
+  // Metrics, in parallel over the images
+  std::vector<double> pixel_error(images);
+  std::vector<double> rand_error(images);
+  std::vector<double> warping_error(images);
+
+#pragma omp parallel for schedule(dynamic)
+  for (int k = 0; k < images; ++k) {
+    pixel_error[k] = PixelError(predictions[k], truths[k]);
+
+    int nr_prediction_seg, nr_truth_seg;
+    cv::Mat prediction_seg = LabelSegments(predictions[k], &nr_prediction_seg);
+    cv::Mat truth_seg = LabelSegments(truths[k], &nr_truth_seg);
+    rand_error[k] = RandError(prediction_seg, nr_prediction_seg, truth_seg,
+                              nr_truth_seg);
+
+    // Foreground: every label except the first (background/membrane)
+    cv::Mat prediction_fg(truths[k].rows, truths[k].cols, CV_8UC1);
+    cv::Mat truth_fg(truths[k].rows, truths[k].cols, CV_8UC1);
+    for (int y = 0; y < truths[k].rows; ++y) {
+      for (int x = 0; x < truths[k].cols; ++x) {
+        prediction_fg.at<uchar>(y, x) = predictions[k].at<int>(y, x) > 0;
+        truth_fg.at<uchar>(y, x) = truths[k].at<int>(y, x) > 0;
+      }
+    }
+    warping_error[k] = WarpingError(prediction_fg, truth_fg);
+  }
+
+  ValidationResult result;
+  result.pixel_error = 0;
+  result.rand_error = 0;
+  result.warping_error = 0;
+  result.images = images;
+  for (int k = 0; k < images; ++k) {
+    result.pixel_error += pixel_error[k] / images;
+    result.rand_error += rand_error[k] / images;
+    result.warping_error += warping_error[k] / images;
+  }
+  return result;
+}
+
+}  // namespace caffe_neural
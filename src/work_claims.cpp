@@ -0,0 +1,258 @@
+/*
+ * work_claims.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "work_claims.hpp"
+#include "tiffio_wrapper.hpp"
+#include "utils.hpp"
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <thread>
+
+namespace caffe_neural {
+
+// Poll interval while waiting for the claims of other workers
+#define CLAIM_POLL_SECONDS 5
+
+std::vector<WorkUnit> MakeWorkUnits(const std::vector<ManifestItem> &items,
+                                    int pages_per_unit) {
+  std::vector<WorkUnit> units;
+  for (unsigned int i = 0; i < items.size(); ++i) {
+    const ManifestItem &item = items[i];
+    std::string stem = item.raw.stem().string();
+    std::string type = bofs::extension(item.raw);
+    std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+
+    int first = 0;
+    int last = -1;
+    if (pages_per_unit > 0 && (type == ".tif" || type == ".tiff")) {
+      first = std::max(item.first_page, 0);
+      last = item.first_page >= 0 ?
+          item.last_page : CountTiffPages(item.raw.string()) - 1;
+    }
+
+    if (last - first + 1 <= pages_per_unit || last < 0) {
+      WorkUnit unit = { item, stem };
+      if (item.first_page >= 0) {
+        unit.name += "_" + ZeroPadNumber(item.first_page, 4) + "-"
+            + ZeroPadNumber(item.last_page, 4);
+      }
+      units.push_back(unit);
+      continue;
+    }
+
+    for (int p = first; p <= last; p += pages_per_unit) {
+      WorkUnit unit = { item, stem };
+      unit.item.first_page = p;
+      unit.item.last_page = std::min(p + pages_per_unit - 1, last);
+      unit.name += "_" + ZeroPadNumber(unit.item.first_page, 4) + "-"
+          + ZeroPadNumber(unit.item.last_page, 4);
+      units.push_back(unit);
+    }
+  }
+
+  // Names are output files and claims, items of the same stem need
+  // disjoint page ranges
+  std::set<std::string> names;
+  for (unsigned int u = 0; u < units.size(); ++u) {
+    if (!names.insert(units[u].name).second) {
+      LOG(FATAL) << "Duplicate work unit " << units[u].name << " ("
+                 << units[u].item.raw << "), items of the same stem need "
+                 << "disjoint page ranges";
+    }
+  }
+  return units;
+}
+
+std::vector<WorkUnit> ShardWorkUnits(const std::vector<WorkUnit> &units,
+                                     int shard, int shards) {
+  std::vector<WorkUnit> shard_units;
+  for (unsigned int u = shard; u < units.size(); u += shards) {
+    shard_units.push_back(units[u]);
+  }
+  return shard_units;
+}
+
+WorkClaims::WorkClaims(std::string dir, int timeout)
+    : dir_(dir),
+      timeout_(timeout),
+      started_(false),
+      stop_(false) {
+  bofs::create_directories(dir_);
+  char host[256] = "";
+  gethostname(host, sizeof(host) - 1);
+  host_ = host;
+  std::stringstream ss;
+  ss << host_ << " " << getpid();
+  owner_ = ss.str();
+  heartbeat_thread_ = std::thread(&WorkClaims::HeartbeatLoop, this);
+}
+
+WorkClaims::~WorkClaims() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  heartbeat_cv_.notify_one();
+  heartbeat_thread_.join();
+}
+
+void WorkClaims::HeartbeatLoop() {
+  std::chrono::milliseconds interval(std::max(timeout_ * 1000 / 4, 100));
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_) {
+    heartbeat_cv_.wait_for(lock, interval);
+    if (stop_ || current_.size() == 0) {
+      continue;
+    }
+    std::string claim_file = dir_ + "/" + current_ + ".claim";
+    if (ReadOwner(claim_file) != owner_) {
+      LOG(WARNING) << "Claim of " << current_ << " was taken over by "
+                   << "another worker (" << ReadOwner(claim_file) << ")";
+      continue;
+    }
+    utime(claim_file.c_str(), nullptr);
+  }
+}
+
+bool WorkClaims::TryClaim(const std::string &name) {
+  std::string claim_file = dir_ + "/" + name + ".claim";
+  int fd = open(claim_file.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  std::string content = owner_ + "\n";
+  if (write(fd, content.c_str(), content.size()) < 0) {
+    LOG(WARNING) << "Could not write claim " << claim_file;
+  }
+  close(fd);
+  std::lock_guard<std::mutex> lock(mutex_);
+  current_ = name;
+  return true;
+}
+
+std::string WorkClaims::ReadOwner(const std::string &claim_file) {
+  std::ifstream in_file(claim_file);
+  std::string owner;
+  std::getline(in_file, owner);
+  return owner;
+}
+
+bool WorkClaims::IsStale(const std::string &claim_file, std::string &owner) {
+  owner = ReadOwner(claim_file);
+  std::stringstream ss(owner);
+  std::string host;
+  int pid = 0;
+  if (ss >> host >> pid && host == host_ && kill(pid, 0) != 0
+      && errno == ESRCH) {
+    // Same host: the owner is gone
+    return true;
+  }
+
+  // Any host: no heartbeat (also covers reused pids and foreign users)
+  struct stat info;
+  if (stat(claim_file.c_str(), &info) != 0) {
+    return false;
+  }
+  return std::difftime(std::time(nullptr), info.st_mtime) > timeout_;
+}
+
+int WorkClaims::Next(const std::vector<WorkUnit> &units) {
+  if (!started_) {
+    for (unsigned int u = 0; u < units.size(); ++u) {
+      open_.push_back(u);
+    }
+    started_ = true;
+  }
+
+  while (true) {
+    // Units still open after this round, done units are never polled again
+    std::vector<int> still_open;
+    for (unsigned int o = 0; o < open_.size(); ++o) {
+      int u = open_[o];
+      std::string base = dir_ + "/" + units[u].name;
+      if (bofs::exists(base + ".done")) {
+        continue;
+      }
+      if (TryClaim(units[u].name)) {
+        // Done by a worker that released the claim in between
+        if (bofs::exists(base + ".done")) {
+          bofs::remove(base + ".claim");
+          std::lock_guard<std::mutex> lock(mutex_);
+          current_.clear();
+          continue;
+        }
+        still_open.insert(still_open.end(), open_.begin() + o + 1,
+                          open_.end());
+        open_.swap(still_open);
+        return u;
+      }
+      std::string owner;
+      if (IsStale(base + ".claim", owner)) {
+        // Only one worker wins the rename of a stale claim
+        std::string dead = base + ".claim.dead." + std::to_string(getpid());
+        if (std::rename((base + ".claim").c_str(), dead.c_str()) == 0) {
+          if (ReadOwner(dead) != owner) {
+            // Raced with another worker that claimed it again: give back,
+            // fails if a third worker claimed the unit in between
+            if (link(dead.c_str(), (base + ".claim").c_str()) == 0) {
+              bofs::remove(dead);
+            } else {
+              LOG(WARNING) << "Could not return the claim of " << units[u].name
+                           << " (" << ReadOwner(dead) << "), claimed again by "
+                           << ReadOwner(base + ".claim") << ", kept as "
+                           << dead;
+            }
+          } else {
+            LOG(WARNING) << "Retrying stale claim of " << units[u].name
+                         << " (" << owner << ")";
+            bofs::remove(dead);
+            if (TryClaim(units[u].name)) {
+              still_open.insert(still_open.end(), open_.begin() + o + 1,
+                                open_.end());
+              open_.swap(still_open);
+              return u;
+            }
+          }
+        }
+      }
+      still_open.push_back(u);
+    }
+    open_.swap(still_open);
+    if (open_.size() == 0) {
+      return -1;
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(CLAIM_POLL_SECONDS));
+  }
+}
+
+void WorkClaims::Done() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (current_.size() == 0) {
+    return;
+  }
+  std::string base = dir_ + "/" + current_;
+  // Atomic: written under a temporary name, then renamed
+  std::string tmp = base + ".done.tmp." + std::to_string(getpid());
+  {
+    std::ofstream out_file(tmp);
+    out_file << owner_ << std::endl;
+  }
+  std::rename(tmp.c_str(), (base + ".done").c_str());
+  bofs::remove(base + ".claim");
+  current_.clear();
+}
+
+}  // namespace caffe_neural